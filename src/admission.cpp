@@ -0,0 +1,170 @@
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+
+// struct limiting how many requests of a route run at the same time, with a bounded queue of waiting requests
+struct routeLimiter {
+    int maxConcurrent;
+    int maxQueued;
+    // how long a queued request waits for a free slot before it is shed
+    int maxWaitMs;
+
+    int active = 0;
+    int queued = 0;
+    long long rejectedQueueFull = 0;
+    long long rejectedTimeout = 0;
+
+    std::mutex mutex;
+    std::condition_variable released;
+};
+
+// The ways a request can be turned away
+enum admissionResult {
+    ADMITTED,
+    REJECTED_QUEUE_FULL,
+    REJECTED_TIMEOUT
+};
+
+// struct to make reading the state of a limiter for metrics easier
+struct limiterStats {
+    int active;
+    int queued;
+    long long rejectedQueueFull;
+    long long rejectedTimeout;
+};
+
+admissionResult admit(routeLimiter &limiter)
+{
+    // Function to wait for a free slot of a route
+    // Requests are rejected right away if the queue is full, so load is shed quickly
+    // @param: limiter - the limiter of the route
+    std::unique_lock<std::mutex> lock(limiter.mutex);
+
+    if (limiter.active < limiter.maxConcurrent)
+    {
+        limiter.active++;
+        return ADMITTED;
+    }
+
+    if (limiter.queued >= limiter.maxQueued)
+    {
+        limiter.rejectedQueueFull++;
+        return REJECTED_QUEUE_FULL;
+    }
+
+    limiter.queued++;
+    bool free = limiter.released.wait_for(lock, std::chrono::milliseconds(limiter.maxWaitMs), [&limiter] {
+        return limiter.active < limiter.maxConcurrent;
+    });
+    limiter.queued--;
+
+    if (!free)
+    {
+        limiter.rejectedTimeout++;
+        return REJECTED_TIMEOUT;
+    }
+
+    limiter.active++;
+    return ADMITTED;
+}
+
+void release(routeLimiter &limiter)
+{
+    // Function to free the slot of a finished request and wake up the next queued one
+    // @param: limiter - the limiter of the route
+    {
+        std::lock_guard<std::mutex> lock(limiter.mutex);
+        limiter.active--;
+    }
+    limiter.released.notify_one();
+}
+
+limiterStats getLimiterStats(routeLimiter &limiter)
+{
+    // Function to read the current state of a limiter
+    // @param: limiter - the limiter of the route
+    std::lock_guard<std::mutex> lock(limiter.mutex);
+    return {limiter.active, limiter.queued, limiter.rejectedQueueFull, limiter.rejectedTimeout};
+}
+
+// struct holding a slot of a route for as long as it lives
+struct admissionTicket {
+    routeLimiter &limiter;
+    admissionResult result;
+
+    admissionTicket(routeLimiter &limiter) : limiter(limiter), result(admit(limiter)) {}
+
+    ~admissionTicket()
+    {
+        if (result == ADMITTED)
+        {
+            release(limiter);
+        }
+    }
+
+    admissionTicket(const admissionTicket &) = delete;
+    admissionTicket &operator=(const admissionTicket &) = delete;
+};
+
+std::shared_ptr<routeLimiter> makeLimiter(int maxConcurrent, int maxQueued, int maxWaitMs)
+{
+    // Function to create the limiter of a route
+    // @param: maxConcurrent - the number of requests running at the same time
+    // @param: maxQueued - the number of requests waiting for a slot
+    // @param: maxWaitMs - how long queued requests wait for a free slot
+    auto limiter = std::make_shared<routeLimiter>();
+    limiter->maxConcurrent = std::max(1, maxConcurrent);
+    limiter->maxQueued = std::max(0, maxQueued);
+    limiter->maxWaitMs = std::max(0, maxWaitMs);
+    return limiter;
+}
+
+int parseRouteLimits(std::string config, int maxWaitMs, std::map<std::string, std::shared_ptr<routeLimiter>> &limiters, std::string &invalidEntry)
+{
+    // Function to override the limits of routes, e.g. "/search/all=2:4,/search/one=8:16"
+    // Only routes which already have a limiter can be overridden, so a misspelled path isn't silently ignored
+    // @param: config - comma separated list of path=concurrency:queue
+    // @param: maxWaitMs - how long queued requests wait for a free slot
+    // @param: limiters - the limiters to override, by path
+    // @param: invalidEntry - set to the entry which couldn't be used on errors
+    std::stringstream stream(config);
+    std::string entry;
+    std::map<std::string, std::shared_ptr<routeLimiter>> parsed;
+
+    while (std::getline(stream, entry, ','))
+    {
+        invalidEntry = entry;
+        size_t equals = entry.find('=');
+        size_t colon = entry.find(':', equals);
+        if (equals == std::string::npos || colon == std::string::npos || limiters.count(entry.substr(0, equals)) == 0)
+        {
+            return 1;
+        }
+
+        try
+        {
+            int maxConcurrent = std::stoi(entry.substr(equals + 1, colon - equals - 1));
+            int maxQueued = std::stoi(entry.substr(colon + 1));
+            parsed[entry.substr(0, equals)] = makeLimiter(maxConcurrent, maxQueued, maxWaitMs);
+        }
+        catch (const std::exception &)
+        {
+            return 1;
+        }
+    }
+
+    invalidEntry = "";
+
+    // Only apply the limits if all of them were valid
+    for (auto &route : parsed)
+    {
+        limiters[route.first] = route.second;
+    }
+
+    return 0;
+}
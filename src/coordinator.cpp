@@ -0,0 +1,388 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <sstream>
+#include <cstdlib>
+
+// struct describing a shard, a normal instance owning part of the books
+struct shard {
+    // e.g. http://localhost:1985
+    std::string url;
+
+    long long requests = 0;
+    long long errors = 0;
+    std::mutex mutex;
+};
+
+// struct holding the answer of another instance
+struct instanceResponse {
+    // 1 if the instance couldn't be reached
+    int errorCode;
+    int status;
+    std::string body;
+    // the Retry-After header of the answer, only sent along when the instance is overloaded
+    std::string retryAfter;
+};
+
+// struct describing where a paginated search over all shards stopped
+struct shardCursor {
+    // index of the shard the next page starts in
+    size_t shard;
+    // cursor returned by that shard, empty to start at its first book
+    std::string cursor;
+    // hash of the query the cursor belongs to
+    unsigned long long queryHash;
+};
+
+int parseShards(std::string config, std::vector<std::shared_ptr<shard>> &shards)
+{
+    // Function to read the shards of the coordinator, e.g. "http://localhost:1985,http://localhost:1986"
+    // The order matters, books are assigned to shards by their position
+    // @param: config - comma separated list of shard URLs
+    // @param: shards - the shards to fill
+    std::stringstream stream(config);
+    std::string url;
+    std::vector<std::shared_ptr<shard>> parsed;
+
+    while (std::getline(stream, url, ','))
+    {
+        if (url.rfind("http://", 0) != 0 || url.size() <= 7)
+        {
+            return 1;
+        }
+        // Paths are appended to the URL
+        while (url.back() == '/')
+        {
+            url.pop_back();
+        }
+
+        auto s = std::make_shared<shard>();
+        s->url = url;
+        parsed.push_back(s);
+    }
+
+    if (parsed.size() == 0)
+    {
+        return 1;
+    }
+
+    shards = parsed;
+    return 0;
+}
+
+size_t getShardIndex(std::string bookId, size_t shardCount)
+{
+    // Function to get the shard owning a book
+    // FNV-1a gives the same shard on every machine, so the coordinator can be restarted or replaced
+    // @param: bookId - the id of the book
+    // @param: shardCount - the number of shards
+    return fnv1a(bookId.data(), bookId.size()) % shardCount;
+}
+
+instanceResponse postToInstance(std::string url, std::string path, std::string body, int timeoutMs)
+{
+    // Function to send a request to another instance and wait for its answer
+    // @param: url - the URL of the instance, e.g. http://localhost:1985
+    // @param: path - the route, e.g. /search/all
+    // @param: body - the json body of the request
+    // @param: timeoutMs - how long to wait for the instance
+    instanceResponse res{1, 0, ""};
+
+    try
+    {
+        auto request = std::make_shared<restbed::Request>(restbed::Uri(url + path));
+        request->set_method("POST");
+        request->set_header("Content-Type", "application/json");
+        request->set_header("Content-Length", std::to_string(body.size()));
+        request->set_body(restbed::Bytes(body.begin(), body.end()));
+
+        auto settings = std::make_shared<restbed::Settings>();
+        settings->set_connection_timeout(std::chrono::milliseconds(timeoutMs));
+
+        auto response = restbed::Http::sync(request, settings);
+        res.status = response->get_status_code();
+        res.retryAfter = response->get_header("Retry-After", std::string(""));
+
+        auto length = response->get_header("Content-Length", 0);
+        restbed::Http::fetch(length, response);
+        auto responseBody = response->get_body();
+        res.body = std::string(responseBody.begin(), responseBody.end());
+
+        // Restbed reports connection errors as responses without a status code
+        res.errorCode = res.status == 0 ? 1 : 0;
+    }
+    catch (const std::exception &)
+    {
+        res.errorCode = 1;
+    }
+
+    return res;
+}
+
+bool isShedResponse(const instanceResponse &res)
+{
+    // Function to check if an instance turned a request away because it is overloaded
+    // This is neither an invalid request nor a failed instance, the client should try again after the Retry-After of the instance
+    // @param: res - the answer of the instance
+    return res.errorCode == 0 && (res.status == 429 || res.status == 503);
+}
+
+instanceResponse forwardToShard(shard &s, std::string path, std::string body, int timeoutMs)
+{
+    // Function to send a request to a shard and wait for its answer
+    // @param: s - the shard
+    // @param: path - the route, e.g. /search/all
+    // @param: body - the json body of the request
+    // @param: timeoutMs - how long to wait for the shard
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.requests++;
+    }
+
+    auto res = postToInstance(s.url, path, body, timeoutMs);
+
+    if (res.errorCode != 0 || (res.status >= 500 && !isShedResponse(res)))
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.errors++;
+    }
+
+    return res;
+}
+
+std::vector<instanceResponse> forwardToAllShards(std::vector<std::shared_ptr<shard>> &shards, std::string path, std::string body, int timeoutMs)
+{
+    // Function to send the same request to every shard at the same time
+    // @param: shards - the shards
+    // @param: path - the route
+    // @param: body - the json body of the request
+    // @param: timeoutMs - how long to wait for each shard
+    std::vector<std::future<instanceResponse>> pending;
+    for (auto &s : shards)
+    {
+        pending.push_back(std::async(std::launch::async, forwardToShard, std::ref(*s), path, body, timeoutMs));
+    }
+
+    std::vector<instanceResponse> responses;
+    for (auto &response : pending)
+    {
+        responses.push_back(response.get());
+    }
+
+    return responses;
+}
+
+std::string encodeShardCursor(shardCursor cursor)
+{
+    // Function to turn a cursor over all shards into an opaque string
+    // @param: cursor - the cursor to encode
+    std::stringstream stream;
+    stream << std::hex << cursor.shard << "." << cursor.queryHash << "." << cursor.cursor;
+    return stream.str();
+}
+
+int decodeShardCursor(std::string encoded, unsigned long long queryHash, size_t shardCount, shardCursor &cursor)
+{
+    // Function to read a cursor returned by encodeShardCursor
+    // @param: encoded - the encoded cursor
+    // @param: queryHash - the hash of the current query, which has to match the one of the cursor
+    // @param: shardCount - the number of shards
+    // @param: cursor - the cursor to fill
+    size_t first = encoded.find('.');
+    size_t second = encoded.find('.', first == std::string::npos ? 0 : first + 1);
+    if (first == std::string::npos || second == std::string::npos)
+    {
+        return 1;
+    }
+
+    std::stringstream shardStream(encoded.substr(0, first));
+    std::stringstream hashStream(encoded.substr(first + 1, second - first - 1));
+    shardStream >> std::hex >> cursor.shard;
+    hashStream >> std::hex >> cursor.queryHash;
+    cursor.cursor = encoded.substr(second + 1);
+
+    if (shardStream.fail() || !shardStream.eof() || hashStream.fail() || !hashStream.eof())
+    {
+        return 1;
+    }
+    if (cursor.queryHash != queryHash || cursor.shard >= shardCount)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+int remainingMs(searchDeadline &deadline)
+{
+    // Function to get the time left until a deadline in milliseconds
+    // @param: deadline - the deadline
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline.end - std::chrono::steady_clock::now()).count();
+    return std::max(0, (int)left);
+}
+
+instanceResponse searchAllShards(std::vector<std::shared_ptr<shard>> &shards, nlohmann::json req, int timeoutMs)
+{
+    // Function to search all shards at the same time and merge their results in the order of the shards
+    // maxResults is applied to the merged results, shards which fail only make them incomplete
+    // @param: shards - the shards
+    // @param: req - the validated request, with its defaults set
+    // @param: timeoutMs - the time budget of the search
+    // @return: the response to send, errorCode 1 if no shard answered, the answer of an overloaded shard as it is
+    size_t limit = resultLimit(false, req["maxResults"]);
+    auto responses = forwardToAllShards(shards, "/search/all", req.dump(), timeoutMs + 1000);
+
+    nlohmann::json searchRes;
+    searchRes["results"] = nlohmann::json::array();
+    bool truncated = false;
+    size_t failed = 0;
+    instanceResponse shed{1, 0, ""};
+
+    for (auto &response : responses)
+    {
+        if (isShedResponse(response))
+        {
+            // Leaving the shard out would make the results incomplete for no good reason, the client waits as long as the most loaded shard asks
+            if (shed.errorCode != 0 || std::atoi(response.retryAfter.c_str()) > std::atoi(shed.retryAfter.c_str()))
+            {
+                shed = response;
+            }
+            continue;
+        }
+        if (response.errorCode != 0 || response.status >= 500)
+        {
+            // The results of the other shards are still valid, but incomplete
+            failed++;
+            truncated = true;
+            continue;
+        }
+        if (response.status != 200)
+        {
+            // Invalid queries are rejected the same way by every shard
+            return response;
+        }
+
+        auto shardRes = nlohmann::json::parse(response.body, nullptr, false);
+        if (shardRes.is_discarded() || !shardRes["results"].is_array())
+        {
+            failed++;
+            truncated = true;
+            continue;
+        }
+
+        for (auto &result : shardRes["results"])
+        {
+            if (searchRes["results"].size() >= limit)
+            {
+                break;
+            }
+            searchRes["results"].push_back(std::move(result));
+        }
+        truncated = truncated || shardRes.value("truncated", false);
+    }
+
+    if (shed.errorCode == 0)
+    {
+        return shed;
+    }
+    if (failed == shards.size())
+    {
+        return {1, 500, ""};
+    }
+
+    searchRes["truncated"] = truncated;
+    return {0, 200, searchRes.dump()};
+}
+
+instanceResponse searchShardsPage(std::vector<std::shared_ptr<shard>> &shards, nlohmann::json req, shardCursor cursor, int pageSize, int timeoutMs)
+{
+    // Function to get one page of the results of all shards, walking through the shards in order
+    // Every shard is only asked for the rest of the page, so the pages are the same as on a single instance
+    // @param: shards - the shards
+    // @param: req - the validated request, with its defaults set
+    // @param: cursor - the shard and the cursor of that shard the page starts at
+    // @param: pageSize - the number of results per page
+    // @param: timeoutMs - the time budget of the search
+    // @return: the response to send, errorCode 1 if a shard failed, the answer of an overloaded shard as it is
+    auto deadline = makeDeadline(timeoutMs);
+    size_t pageLimit = std::max(1, pageSize);
+
+    nlohmann::json searchRes;
+    searchRes["results"] = nlohmann::json::array();
+    searchRes["truncated"] = false;
+    searchRes["nextCursor"] = nullptr;
+
+    for (size_t s = cursor.shard; s < shards.size(); s++)
+    {
+        // The first shard is always asked, it gets past its cursor even if the time is already up
+        if (s != cursor.shard && deadline.check())
+        {
+            // Let the next page start with this shard
+            searchRes["truncated"] = true;
+            searchRes["nextCursor"] = encodeShardCursor({s, cursor.cursor, cursor.queryHash});
+            break;
+        }
+
+        req["pageSize"] = pageLimit - searchRes["results"].size();
+        req["timeoutMs"] = remainingMs(deadline);
+        if (cursor.cursor.size() > 0)
+        {
+            req["cursor"] = cursor.cursor;
+        }
+        else
+        {
+            req.erase("cursor");
+        }
+
+        auto response = forwardToShard(*shards[s], "/search/all", req.dump(), remainingMs(deadline) + 1000);
+        if (isShedResponse(response))
+        {
+            // The client can ask for the same page again once the shard has room
+            return response;
+        }
+        if (response.errorCode != 0 || response.status >= 500)
+        {
+            // Skipping the shard would skip its results for good
+            return {1, 500, ""};
+        }
+        if (response.status != 200)
+        {
+            return response;
+        }
+
+        auto shardRes = nlohmann::json::parse(response.body, nullptr, false);
+        if (shardRes.is_discarded() || !shardRes["results"].is_array())
+        {
+            return {1, 500, ""};
+        }
+
+        for (auto &result : shardRes["results"])
+        {
+            searchRes["results"].push_back(std::move(result));
+        }
+        searchRes["truncated"] = searchRes["truncated"].get<bool>() || shardRes.value("truncated", false);
+
+        if (shardRes["nextCursor"].is_string())
+        {
+            // The shard has more results, the next page continues in it
+            searchRes["nextCursor"] = encodeShardCursor({s, shardRes["nextCursor"], cursor.queryHash});
+            break;
+        }
+
+        // The next shard starts at its first book
+        cursor.cursor = "";
+        if (searchRes["results"].size() >= pageLimit)
+        {
+            if (s + 1 < shards.size())
+            {
+                searchRes["nextCursor"] = encodeShardCursor({s + 1, "", cursor.queryHash});
+            }
+            break;
+        }
+    }
+
+    return {0, 200, searchRes.dump()};
+}
@@ -5,20 +5,35 @@
 #include <vector>
 #include <iterator>
 #include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <cstdlib>
+#include "unicode.cpp"
 
-// struct to make passing around the results between functions easier
-struct searchResult {
-    std::string bookId;
-    std::string bookName;
-    int pos;
-    std::string periText;
-};
+// struct used to stop a search cooperatively once its time budget is used up
+struct searchDeadline {
+    std::chrono::steady_clock::time_point end;
+    bool expired = false;
 
-struct searchResults {
-    int errorCode;
-    std::vector<searchResult> results;
+    bool check()
+    {
+        if (!expired && std::chrono::steady_clock::now() >= end)
+        {
+            expired = true;
+        }
+        return expired;
+    }
 };
 
+searchDeadline makeDeadline(int timeoutMs)
+{
+    // Function to create a deadline timeoutMs from now
+    // @param: timeoutMs - the time budget in milliseconds
+    searchDeadline deadline;
+    deadline.end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    return deadline;
+}
+
 // struct to make passing around rows returned from SQL queries easier
 struct SQLRow {
     std::vector<std::string> row;
@@ -44,7 +59,7 @@ static int callback(void *NotUsed, int argc, char **argv, char **azColName)
     return 0;
 }
 
-int executePreparedStatement(sqlite3 *db, std::string sql, std::string *arguments)
+int executePreparedStatement(sqlite3 *db, std::string sql, const std::vector<std::string> &arguments)
 {
     // Function used to simplify making prepared statements
     // @param: db - the database
@@ -59,7 +74,7 @@ int executePreparedStatement(sqlite3 *db, std::string sql, std::string *argument
         &stmt,
         nullptr);
 
-    for (int i = 0; i < sizeof(arguments); i++)
+    for (size_t i = 0; i < arguments.size(); i++)
     {
         sqlite3_bind_text(
             stmt,
@@ -86,7 +101,7 @@ int executePreparedStatement(sqlite3 *db, std::string sql, std::string *argument
     return rc;
 }
 
-SQLResults getResultsFromPreparedStatement(sqlite3 *db, std::string sql, std::string *arguments)
+SQLResults getResultsFromPreparedStatement(sqlite3 *db, std::string sql, const std::vector<std::string> &arguments)
 {
     // Function used to simplify making prepared statements and reading results
     // @param: db - the database
@@ -102,7 +117,7 @@ SQLResults getResultsFromPreparedStatement(sqlite3 *db, std::string sql, std::st
         &stmt,
         nullptr);
 
-    for (int i = 0; i < sizeof(arguments); i++)
+    for (size_t i = 0; i < arguments.size(); i++)
     {
         sqlite3_bind_text(
             stmt,
@@ -115,7 +130,9 @@ SQLResults getResultsFromPreparedStatement(sqlite3 *db, std::string sql, std::st
     // vector storing the rows returned
     std::vector<SQLRow> results;
 
-    while (sqlite3_step(stmt) != SQLITE_DONE)
+    // Stop on errors as well, e.g. SQLITE_BUSY, stepping again would return the same error forever
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
     {
         int i;
         int num_cols = sqlite3_column_count(stmt);
@@ -136,13 +153,19 @@ SQLResults getResultsFromPreparedStatement(sqlite3 *db, std::string sql, std::st
         }
 
         // Push the row into the results vector
-        results.push_back(curCol);
+        results.push_back(std::move(curCol));
     }
 
     sqlite3_finalize(stmt);
 
     SQLResults res;
-    res.results = results;
+    if (rc != SQLITE_DONE)
+    {
+        res.errorCode = 1;
+        return res;
+    }
+
+    res.results = std::move(results);
     res.errorCode = 0;
 
     return res;
@@ -154,7 +177,7 @@ int createTable(sqlite3 *db)
     // @param: db - the database
     char *zErrMsg = 0;
 
-    std::string arguments[0] = {};
+    std::vector<std::string> arguments = {};
     std::string sql = "CREATE TABLE fulltext(ID INTEGER PRIMARY KEY AUTOINCREMENT, bookId TEXT NOT NULL, bookName TEXT NOT NULL, text TEXT NOT NULL);";
 
     int rc = executePreparedStatement(db, sql, arguments);
@@ -162,6 +185,435 @@ int createTable(sqlite3 *db)
     return rc;
 }
 
+int createChangesTable(sqlite3 *db)
+{
+    // Function to create the table recording the generation of the last change of every row
+    // Triggers keep it up to date, so every write to fulltext bumps the generation in the same statement
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::vector<std::string> statements = {
+        "CREATE TABLE IF NOT EXISTS fulltext_changes(ID INTEGER PRIMARY KEY, generation INTEGER NOT NULL);",
+        "CREATE INDEX IF NOT EXISTS fulltext_changes_generation ON fulltext_changes(generation);",
+        "CREATE TRIGGER IF NOT EXISTS fulltext_insert AFTER INSERT ON fulltext BEGIN "
+        "INSERT OR REPLACE INTO fulltext_changes(ID, generation) VALUES (NEW.ID, (SELECT IFNULL(MAX(generation), 0) + 1 FROM fulltext_changes)); END;",
+        "CREATE TRIGGER IF NOT EXISTS fulltext_update AFTER UPDATE ON fulltext BEGIN "
+        "INSERT OR REPLACE INTO fulltext_changes(ID, generation) VALUES (NEW.ID, (SELECT IFNULL(MAX(generation), 0) + 1 FROM fulltext_changes)); END;",
+        "CREATE TRIGGER IF NOT EXISTS fulltext_delete AFTER DELETE ON fulltext BEGIN "
+        "INSERT OR REPLACE INTO fulltext_changes(ID, generation) VALUES (OLD.ID, (SELECT IFNULL(MAX(generation), 0) + 1 FROM fulltext_changes)); END;"};
+
+    for (auto &sql : statements)
+    {
+        if (executePreparedStatement(db, sql, arguments) != 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+long long getGeneration(sqlite3 *db)
+{
+    // Function to get the generation of the last change to the database
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::string sql = "SELECT CAST(IFNULL(MAX(generation), 0) AS TEXT) FROM fulltext_changes;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0)
+    {
+        return -1;
+    }
+
+    return std::stoll(res.results[0].row[0]);
+};
+
+long long countBooks(sqlite3 *db)
+{
+    // Function to count the rows of the fulltext table
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::string sql = "SELECT CAST(COUNT(*) AS TEXT) FROM fulltext;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0)
+    {
+        return -1;
+    }
+
+    return std::stoll(res.results[0].row[0]);
+};
+
+SQLResults getChangesSince(sqlite3 *db, long long generation)
+{
+    // Function to get the rows changed after a generation, with the generation of their last change
+    // @param: db - the database
+    // @param: generation - the generation to get the changes after
+    std::vector<std::string> arguments = {std::to_string(generation)};
+    std::string sql = "SELECT CAST(ID AS TEXT), CAST(generation AS TEXT) FROM fulltext_changes WHERE generation > ? ORDER BY generation;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+
+    return res;
+};
+
+SQLResults getChangeLog(sqlite3 *db, long long generation, int limit)
+{
+    // Function to read the change log after a generation, every changed row with its current content
+    // Only the last change of every row is kept, so replaying the log always ends in the current state
+    // @param: db - the database
+    // @param: generation - the generation to get the changes after
+    // @param: limit - the maximum number of changes to return
+    // @return: rows of generation, ID, 1 if the row was removed, bookId, bookName and text
+    std::vector<std::string> arguments = {std::to_string(generation)};
+    std::string sql = "SELECT CAST(c.generation AS TEXT), CAST(c.ID AS TEXT), CAST(f.ID IS NULL AS TEXT), IFNULL(f.bookId, ''), IFNULL(f.bookName, ''), IFNULL(f.text, '') "
+                      "FROM fulltext_changes c LEFT JOIN fulltext f ON f.ID = c.ID WHERE c.generation > ? ORDER BY c.generation LIMIT " + std::to_string(limit) + ";";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+
+    return res;
+};
+
+int createReplicasTable(sqlite3 *db)
+{
+    // Function to create the tables recording how far every replica read the change log and up to which generation removals were pruned from it
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::vector<std::string> statements = {
+        "CREATE TABLE IF NOT EXISTS fulltext_replicas(ID TEXT PRIMARY KEY, generation INTEGER NOT NULL, seen INTEGER NOT NULL);",
+        "CREATE TABLE IF NOT EXISTS fulltext_pruned(ID INTEGER PRIMARY KEY CHECK (ID = 1), generation INTEGER NOT NULL);",
+        "INSERT OR IGNORE INTO fulltext_pruned(ID, generation) VALUES (1, 0);"};
+
+    for (auto &sql : statements)
+    {
+        if (executePreparedStatement(db, sql, arguments) != 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int recordReplica(sqlite3 *db, std::string replicaId, long long generation)
+{
+    // Function to remember that a replica applied the change log up to a generation
+    // @param: db - the database
+    // @param: replicaId - the id of the database of the replica
+    // @param: generation - the generation the replica asked for the changes after
+    std::vector<std::string> arguments = {replicaId, std::to_string(generation)};
+    std::string sql = "INSERT OR REPLACE INTO fulltext_replicas(ID, generation, seen) VALUES (?1, ?2, strftime('%s', 'now'));";
+
+    return executePreparedStatement(db, sql, arguments);
+};
+
+long long getPrunedGeneration(sqlite3 *db)
+{
+    // Function to get the generation up to which removals were pruned from the change log
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::string sql = "SELECT CAST(generation AS TEXT) FROM fulltext_pruned WHERE ID = 1;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0)
+    {
+        return -1;
+    }
+
+    return std::stoll(res.results[0].row[0]);
+};
+
+long long pruneChangeLog(sqlite3 *db, long long retentionSeconds)
+{
+    // Function to delete the entries of removed rows from the change log once every replica read past them
+    // Replicas not seen for retentionSeconds are forgotten, they start over if they come back behind the pruned generation
+    // The newest entry is always kept, it holds the generation of the database
+    // @param: db - the database
+    // @param: retentionSeconds - how long a replica is waited for
+    // @return: the number of entries deleted, -1 on errors
+    std::vector<std::string> arguments = {std::to_string(retentionSeconds)};
+    if (executePreparedStatement(db, "DELETE FROM fulltext_replicas WHERE seen < strftime('%s', 'now') - ?1;", arguments) != 0)
+    {
+        return -1;
+    }
+
+    // Without replicas every entry is read past, a new replica has no rows to remove
+    std::string bound = "SELECT MIN(IFNULL((SELECT MIN(generation) FROM fulltext_replicas), MAX(generation)), MAX(generation) - 1) FROM fulltext_changes";
+    std::string prunable = "FROM fulltext_changes WHERE generation <= (" + bound + ") AND ID NOT IN (SELECT ID FROM fulltext)";
+
+    auto res = getResultsFromPreparedStatement(db, "SELECT CAST(COUNT(*) AS TEXT), CAST(IFNULL(MAX(generation), 0) AS TEXT) " + prunable + ";", arguments);
+    if (res.errorCode != 0 || res.results.size() == 0 || res.results[0].row.size() < 2)
+    {
+        return -1;
+    }
+    long long count = std::stoll(res.results[0].row[0]);
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // Stored first, so replicas behind it start over even if the server stops in between
+    std::vector<std::string> pruned = {res.results[0].row[1]};
+    if (executePreparedStatement(db, "UPDATE fulltext_pruned SET generation = MAX(generation, ?1) WHERE ID = 1;", pruned) != 0 ||
+        executePreparedStatement(db, "DELETE " + prunable + ";", arguments) != 0)
+    {
+        return -1;
+    }
+
+    return count;
+};
+
+int createIdentityTable(sqlite3 *db)
+{
+    // Function to create the table holding the random id of the database, so replicas notice when the database of their primary is replaced
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::vector<std::string> statements = {
+        "CREATE TABLE IF NOT EXISTS fulltext_identity(ID INTEGER PRIMARY KEY CHECK (ID = 1), databaseId TEXT NOT NULL);",
+        "INSERT OR IGNORE INTO fulltext_identity(ID, databaseId) VALUES (1, lower(hex(randomblob(16))));"};
+
+    for (auto &sql : statements)
+    {
+        if (executePreparedStatement(db, sql, arguments) != 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+std::string getDatabaseId(sqlite3 *db)
+{
+    // Function to get the random id of the database
+    // @param: db - the database
+    // @return: the id, empty on errors
+    std::vector<std::string> arguments = {};
+    std::string sql = "SELECT databaseId FROM fulltext_identity WHERE ID = 1;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0)
+    {
+        return "";
+    }
+
+    return res.results[0].row[0];
+};
+
+int createReplicationTable(sqlite3 *db)
+{
+    // Function to create the table storing up to which generation of the primary a replica applied the change log
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::vector<std::string> statements = {
+        "CREATE TABLE IF NOT EXISTS fulltext_replication(ID INTEGER PRIMARY KEY CHECK (ID = 1), generation INTEGER NOT NULL, primaryId TEXT NOT NULL DEFAULT '');",
+        "INSERT OR IGNORE INTO fulltext_replication(ID, generation) VALUES (1, 0);"};
+
+    for (auto &sql : statements)
+    {
+        if (executePreparedStatement(db, sql, arguments) != 0)
+        {
+            return 1;
+        }
+    }
+
+    // Tables created before the id of the primary was stored don't have the column yet
+    auto columns = getResultsFromPreparedStatement(db, "SELECT name FROM pragma_table_info('fulltext_replication') WHERE name = 'primaryId';", arguments);
+    if (columns.errorCode != 0)
+    {
+        return 1;
+    }
+    if (columns.results.size() == 0)
+    {
+        return executePreparedStatement(db, "ALTER TABLE fulltext_replication ADD COLUMN primaryId TEXT NOT NULL DEFAULT '';", arguments);
+    }
+
+    return 0;
+}
+
+long long getReplicatedGeneration(sqlite3 *db)
+{
+    // Function to get the generation of the primary the replica is up to date with
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+    std::string sql = "SELECT CAST(generation AS TEXT) FROM fulltext_replication WHERE ID = 1;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0)
+    {
+        return -1;
+    }
+
+    return std::stoll(res.results[0].row[0]);
+};
+
+std::string getReplicatedPrimary(sqlite3 *db)
+{
+    // Function to get the id of the database of the primary the replica applied the changes of
+    // @param: db - the database
+    // @return: the id, empty if the replica didn't apply any changes yet or on errors
+    std::vector<std::string> arguments = {};
+    std::string sql = "SELECT primaryId FROM fulltext_replication WHERE ID = 1;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0)
+    {
+        return "";
+    }
+
+    return res.results[0].row[0];
+};
+
+int setReplicatedPrimary(sqlite3 *db, std::string primaryId)
+{
+    // Function to store the database of the primary a replica follows, starting again at generation 0
+    // @param: db - the database
+    // @param: primaryId - the id of the database of the primary
+    std::vector<std::string> arguments = {primaryId};
+    std::string sql = "UPDATE fulltext_replication SET generation = 0, primaryId = ?1 WHERE ID = 1;";
+
+    return executePreparedStatement(db, sql, arguments);
+};
+
+int setReplicatedGeneration(sqlite3 *db, long long generation)
+{
+    // Function to store the generation of the primary the replica is up to date with
+    // @param: db - the database
+    // @param: generation - the generation of the primary
+    std::vector<std::string> arguments = {std::to_string(generation)};
+    std::string sql = "UPDATE fulltext_replication SET generation = ?1 WHERE ID = 1;";
+
+    return executePreparedStatement(db, sql, arguments);
+};
+
+int putBookRow(sqlite3 *db, long long rowId, std::string bookId, std::string bookName, std::string text)
+{
+    // Function to write a row of the primary to a replica, keeping its ID
+    // @param: db - the database
+    // @param: rowId - the ID of the row on the primary
+    // @param: bookId - the id of the book
+    // @param: bookName - the name of the book
+    // @param: text - the text of the book
+    std::vector<std::string> arguments = {std::to_string(rowId), bookId, bookName, text};
+    std::string sql = "INSERT OR REPLACE INTO fulltext(ID, bookId, bookName, text) VALUES (?1, ?2, ?3, ?4);";
+
+    return executePreparedStatement(db, sql, arguments);
+};
+
+int deleteBookRow(sqlite3 *db, long long rowId)
+{
+    // Function to remove a row by its ID
+    // @param: db - the database
+    // @param: rowId - the ID of the row
+    std::vector<std::string> arguments = {std::to_string(rowId)};
+    std::string sql = "DELETE FROM fulltext WHERE ID = ?1;";
+
+    return executePreparedStatement(db, sql, arguments);
+};
+
+long long getPragmaValue(sqlite3 *db, std::string pragma)
+{
+    // Function to read a numeric setting or counter of the database, e.g. freelist_count
+    // @param: db - the database
+    // @param: pragma - the name of the pragma
+    std::vector<std::string> arguments = {};
+    std::string sql = "SELECT CAST(" + pragma + " AS TEXT) FROM pragma_" + pragma + ";";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0)
+    {
+        return -1;
+    }
+
+    return std::stoll(res.results[0].row[0]);
+};
+
+int configureStorage(sqlite3 *db)
+{
+    // Function to switch the database to incremental vacuum and a write-ahead log, so free pages can be reclaimed in the background
+    // auto_vacuum only applies to a database without tables, one that already has tables is converted by vacuuming it once
+    // @param: db - the database
+    std::vector<std::string> arguments = {};
+
+    // Has to come first, switching to WAL already writes the first page
+    if (executePreparedStatement(db, "PRAGMA auto_vacuum = INCREMENTAL;", arguments) != 0)
+    {
+        return 1;
+    }
+
+    // 2 is INCREMENTAL
+    if (getPragmaValue(db, "auto_vacuum") != 2)
+    {
+        auto tables = getResultsFromPreparedStatement(db, "SELECT CAST(count(*) AS TEXT) FROM sqlite_master;", arguments);
+        if (tables.errorCode != 0 || tables.results.size() == 0 || tables.results[0].row.size() == 0)
+        {
+            return 1;
+        }
+        if (tables.results[0].row[0] != "0")
+        {
+            std::cout << "Vacuuming the database once to enable incremental vacuum" << std::endl;
+            if (executePreparedStatement(db, "VACUUM;", arguments) != 0)
+            {
+                return 1;
+            }
+        }
+    }
+
+    auto res = getResultsFromPreparedStatement(db, "PRAGMA journal_mode = WAL;", arguments);
+    if (res.results.size() == 0 || res.results[0].row.size() == 0 || res.results[0].row[0] != "wal")
+    {
+        return 1;
+    }
+
+    // Without a limit the log keeps the size of the largest write after checkpoints
+    if (getResultsFromPreparedStatement(db, "PRAGMA journal_size_limit = 8388608;", arguments).results.size() == 0)
+    {
+        return 1;
+    }
+
+    return 0;
+};
+
+long long incrementalVacuum(sqlite3 *db, int pages)
+{
+    // Function to return free pages of the database to the file system
+    // @param: db - the database
+    // @param: pages - the maximum number of pages to reclaim
+    // @return: the number of pages reclaimed, -1 on errors
+    std::vector<std::string> arguments = {};
+    std::string sql = "PRAGMA incremental_vacuum(" + std::to_string(pages) + ");";
+
+    // Every reclaimed page is returned as a row
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+    if (res.errorCode != 0)
+    {
+        return -1;
+    }
+    return res.results.size();
+};
+
+int checkpointWAL(sqlite3 *db, int &walPages, int &checkpointedPages)
+{
+    // Function to copy the pages of the write-ahead log into the database without waiting for readers or writers
+    // @param: db - the database
+    // @param: walPages - set to the number of pages in the log
+    // @param: checkpointedPages - set to the number of pages copied into the database
+    return sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &walPages, &checkpointedPages) == SQLITE_OK ? 0 : 1;
+};
+
+SQLResults getBookByRowId(sqlite3 *db, long long rowId)
+{
+    // Function to get a book by its ID in the fulltext table
+    // @param: db - the database
+    // @param: rowId - the ID of the row
+    std::vector<std::string> arguments = {std::to_string(rowId)};
+    std::string sql = "SELECT CAST(ID AS TEXT), bookId, bookName, text FROM fulltext WHERE ID = ?;";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+
+    return res;
+};
+
 SQLResults getBook(sqlite3 *db, std::string bookId)
 {
     // Function to search for a book in the database
@@ -169,7 +621,7 @@ SQLResults getBook(sqlite3 *db, std::string bookId)
     // @param: bookId - the id of the book to edit
     char *zErrMsg = 0;
 
-    std::string arguments[1] = {bookId};
+    std::vector<std::string> arguments = {bookId};
     std::string sql = "SELECT * FROM fulltext WHERE bookId = ?;";
 
     auto res = getResultsFromPreparedStatement(db, sql, arguments);
@@ -177,13 +629,27 @@ SQLResults getBook(sqlite3 *db, std::string bookId)
     return res;
 };
 
+SQLResults getBooksFrom(sqlite3 *db, long long rowId, int limit)
+{
+    // Function to get the books starting at a given row, in insertion order
+    // @param: db - the database
+    // @param: rowId - the ID of the first book to return
+    // @param: limit - the maximum number of books to return
+    std::vector<std::string> arguments = {std::to_string(rowId)};
+    std::string sql = "SELECT CAST(ID AS TEXT), bookId, bookName, text FROM fulltext WHERE ID >= ? ORDER BY ID LIMIT " + std::to_string(limit) + ";";
+
+    auto res = getResultsFromPreparedStatement(db, sql, arguments);
+
+    return res;
+};
+
 SQLResults getAllBooks(sqlite3 *db)
 {
     // Function to get all books in the database
     // @param: db - the database
     char *zErrMsg = 0;
 
-    std::string arguments[0] = {};
+    std::vector<std::string> arguments = {};
     std::string sql = "SELECT * FROM fulltext;";
 
     auto res = getResultsFromPreparedStatement(db, sql, arguments);
@@ -201,7 +667,7 @@ int addBook(sqlite3 *db, std::string bookId, std::string bookName, std::string t
     char *zErrMsg = 0;
 
     std::string sql = "INSERT INTO fulltext(bookId, bookName, text) VALUES (?1, ?2, ?3);";
-    std::string arguments[3] = {bookId, bookName, text};
+    std::vector<std::string> arguments = {bookId, bookName, text};
     int rc = executePreparedStatement(db, sql, arguments);
 
     return rc;
@@ -218,7 +684,7 @@ int editBook(sqlite3 *db, std::string bookId, std::string bookName, std::string
     char *zErrMsg = 0;
 
     std::string sql = "UPDATE fulltext SET bookName = ?1, text = ?2 WHERE bookId = ?3;";
-    std::string arguments[3] = {bookName, text, bookId};
+    std::vector<std::string> arguments = {bookName, text, bookId};
     int rc = executePreparedStatement(db, sql, arguments);
 
     return rc;
@@ -232,7 +698,7 @@ int removeBook(sqlite3 *db, std::string bookId)
     char *zErrMsg = 0;
 
     std::string sql = "DELETE FROM fulltext WHERE bookId = ?1;";
-    std::string arguments[1] = {bookId};
+    std::vector<std::string> arguments = {bookId};
     int rc = executePreparedStatement(db, sql, arguments);
 
     return rc;
@@ -245,12 +711,26 @@ int removeAllBooks(sqlite3 *db)
     char *zErrMsg = 0;
 
     std::string sql = "DELETE FROM fulltext;";
-    std::string arguments[1] = {};
+    std::vector<std::string> arguments = {};
     int rc = executePreparedStatement(db, sql, arguments);
 
     return rc;
 };
 
+unsigned long long fnv1a(const char *data, size_t size, unsigned long long hash = 14695981039346656037ULL)
+{
+    // Function to hash bytes with FNV-1a, which gives the same hash on every machine and run
+    // @param: data - the bytes to hash
+    // @param: size - the number of bytes
+    // @param: hash - the hash of the bytes before, to hash data in several pieces
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 // for string delimiter
 std::vector<std::string> split(std::string s, std::string delimiter)
 {
@@ -273,23 +753,30 @@ std::vector<std::string> split(std::string s, std::string delimiter)
     return res;
 }
 
-std::string normaliseWord(std::string word)
+std::u32string normaliseWord(const std::string &word)
 {
-    // Function to normalise text : remove punctuation, make lowercase
+    // Function to normalise text : remove punctuation, make lowercase, remove diacritics
+    // The result are code points, so fuzzy matching counts letters of every script the same way
+    // Case and diacritics are folded for Latin, Greek and Cyrillic, see foldBlocks in unicode.cpp
     // @param: word - the word to normalise
+    std::u32string result;
+    result.reserve(word.size());
 
-    std::string result;
-
-    for (auto c : word)
+    for (unsigned char c : word)
     {
+        if (c >= 0x80)
+        {
+            // Only words which aren't plain ASCII go through the Unicode tables
+            return foldWord(word);
+        }
         if (!std::ispunct(c))
-            result += tolower(c);
+            result += (char32_t)tolower(c);
     }
 
     return result;
 }
 
-bool checkMatch(std::string normalisedWord, std::string normalisedSearch) {
+bool checkMatch(const std::u32string &normalisedWord, const std::u32string &normalisedSearch) {
     // Check if words are longer than 0
     if(normalisedWord.size() == 0 || normalisedSearch.size() == 0)
     {
@@ -302,17 +789,14 @@ bool checkMatch(std::string normalisedWord, std::string normalisedSearch) {
     // Check if normalisedSearch is contained within normalisedWord
     if(normalisedWord.size() > 4)
     {
-        if(abs(normalisedSearch.size() - normalisedWord.size()) < 3)
+        if(std::abs((int)normalisedSearch.size() - (int)normalisedWord.size()) < 3)
         {
-            if (normalisedWord.find(normalisedSearch) != std::string::npos)
+            if (normalisedWord.find(normalisedSearch) != std::u32string::npos)
             {
                 return true;
             };
-        };
 
-        if(abs(normalisedSearch.size() - normalisedWord.size()) < 3)
-        {
-            if (normalisedSearch.find(normalisedWord) != std::string::npos)
+            if (normalisedSearch.find(normalisedWord) != std::u32string::npos)
             {
                 return true;
             };
@@ -322,171 +806,52 @@ bool checkMatch(std::string normalisedWord, std::string normalisedSearch) {
     return false;
 }
 
-bool checkMutations(std::string normalisedWord, std::string normalisedSearch) {
-    // Check if mutations of normalisedSearch match
-    std::string alphabet = "abcdefghijklmnopqrstuvwxyz";
-    for(int i = 0; i < normalisedSearch.size(); i++) {
-        // 27 not 26, to replace by nothing too
-        for(int j = 0; j < 27; j++) {
-            auto mutatedSearch = normalisedSearch;
-
-            if (checkMatch(normalisedWord, mutatedSearch.replace(i, 1, alphabet.substr(j, 1)))) return true;
-        }
-    }
-    return false;
-}
+bool checkMutations(const std::u32string &normalisedWord, const std::u32string &normalisedSearch, searchDeadline *deadline = nullptr) {
+    // Check if mutations of normalisedSearch match, every code point is replaced by another one or removed
+    int wordLength = normalisedWord.size();
+    int searchLength = normalisedSearch.size();
 
-bool checkWords(std::vector<std::string> splitTextWordList, std::vector<std::string> splitSearchText)
-{
-    int correctWords = 0;
+    // Mutations are as long as the search or one shorter, skip words which can't match at that length
+    if (wordLength <= 4 && wordLength != searchLength && wordLength != searchLength - 1) return false;
+    if (wordLength > 4 && std::min(std::abs(searchLength - wordLength), std::abs(searchLength - 1 - wordLength)) >= 3) return false;
 
-    // Loop through all the words
-    for (int i = 0; i < splitTextWordList.size(); i++)
-    {
-        // normalise both words to maximise chances of a match
-        auto normalisedWord = normaliseWord(splitTextWordList[i]);
-        auto normalisedSearch = normaliseWord(splitSearchText[i]);
-
-        if(checkMatch(normalisedWord, normalisedSearch))
-        {
-            correctWords++;
-            continue;
-        }
-
-        if(checkMutations(normalisedWord, normalisedSearch))
-        {
-            correctWords++;
-            continue;
-        }
+    // A replacement can only help if the word contains it, so the code points of the word are the alphabet
+    std::u32string alphabet;
+    for (auto c : normalisedWord) {
+        if (alphabet.find(c) == std::u32string::npos) alphabet += c;
     }
 
-    // The number of matching words has to be the same as the number of words in the search query
-    if (correctWords == splitTextWordList.size())
-    {
-        return true;
-    }
+    for(int i = 0; i < searchLength; i++) {
+        // Give up once the search is out of time
+        if (deadline != nullptr && deadline->check()) return false;
 
-    return false;
-}
-
-searchResults searchBook(sqlite3 *db, std::string bookId, std::string searchText, int stopAfterOne, int minPeriTextLength = 15, int maxResults = 100000)
-{
-    // Function to search for text in a single book
-    // @param: db - the database
-    // @param: bookId - the id of the book
-    // @param: searchText - the text to search for
-    // @param: stopAfterOne - argument specifying if function should continue to search after it found first result
-    SQLResults res = getBook(db, bookId);
-
-    searchResults sRes;
-
-    if (res.errorCode == 1) {
-        sRes.errorCode = 1;
-        return sRes;
-    }        
-    if (res.results.size() == 0) {
-        sRes.errorCode = 0;
-        return sRes;
-    }
+        auto mutatedSearch = normalisedSearch;
 
-    std::string text = res.results[0].row[2];
+        // Replace by nothing
+        if (checkMatch(normalisedWord, mutatedSearch.erase(i, 1))) return true;
 
-    auto splitText = split(text, " ");
-    auto splitTextLength = splitText.size();
-    auto splitSearchText = split(searchText, " ");
-    auto searchTextLength = splitSearchText.size();
+        for(auto c : alphabet) {
+            mutatedSearch = normalisedSearch;
+            mutatedSearch[i] = c;
 
-    bool stop = false;
-    int results = 0;
-
-    for (int i = 0; i < splitText.size(); i++)
-    {
-        // Create list of next words to come
-        std::vector<std::string> splitTextWordList;
-        for (int j = 0; j < searchTextLength; j++)
-        {
-            if (i + j >= splitTextLength)
-            {
-                stop = true;
-                break;
-            }
-
-            splitTextWordList.push_back(splitText[i + j]);
-        }
-
-        if (stop)
-            break;
-
-        // Check if words match by using function to have easy expandability
-        if (checkWords(splitTextWordList, splitSearchText))
-        {
-            std::string periText = "";
-            int periTextLength = std::max(minPeriTextLength, (int)splitTextWordList.size());
-            for (int j = 0; j < periTextLength; j++)
-            {
-                if((i - (periTextLength / 2) + j) >= splitTextLength) {
-                    break;
-                };
-                periText += splitText[i - (periTextLength / 2) + j];
-                periText += " ";
-            }
-            searchResult sR{bookId, res.results[0].row[1], i, periText};
-            sRes.results.push_back(sR);
-
-            results++;
-
-            if (stopAfterOne)
-            {
-                sRes.errorCode = 0;
-                return sRes;
-            }
-
-            if (results > maxResults) {
-                sRes.errorCode = 0;
-                return sRes;
-            }
+            if (checkMatch(normalisedWord, mutatedSearch)) return true;
         }
     }
+    return false;
+}
 
-    sRes.errorCode = 0;
-    return sRes;
-};
-
-searchResults searchAllBooks(sqlite3 *db, std::string searchText, bool stopAfterOne, int minPeriTextLength = 15, int maxResults = 100000)
+bool checkWord(const std::u32string &normalisedWord, const std::u32string &normalisedSearch, searchDeadline *deadline = nullptr)
 {
-    // Function to search for text in all book
-    // @param: db - the database
-    // @param: searchText - the text to search for
-    // @param: stopAfterOne - argument specifying if function should continue to search after it found first result
-    auto res = getAllBooks(db);
-
-    searchResults searchResults;
-
-    if(res.errorCode == 1) {
-        searchResults.errorCode = 1;
-        return searchResults;
-    }
-    if(res.results.size() == 0) {
-        searchResults.errorCode = 0;
-        return searchResults;
-    }
-
-    for (auto bookId : res.results)
+    // Check if a normalised word of the text matches a normalised word of the search, directly or with a mutation
+    // @param: normalisedWord - the normalised word of the text
+    // @param: normalisedSearch - the normalised word of the search
+    if(checkMatch(normalisedWord, normalisedSearch))
     {
-        auto res = searchBook(db, bookId.row[0], searchText, stopAfterOne, minPeriTextLength, maxResults);
-        if(res.errorCode == 1) {
-            res.errorCode = 1;
-            return searchResults;
-        }
-        if (res.results.size() > 0)
-        {
-            std::copy(res.results.begin(), res.results.end(), std::back_inserter(searchResults.results));
-        }
+        return true;
     }
 
-    searchResults.errorCode = 0;
-    return searchResults;
-};
+    return checkMutations(normalisedWord, normalisedSearch, deadline);
+}
 
 sqlite3 *initDB()
 {
@@ -503,8 +868,18 @@ sqlite3 *initDB()
     }
     else
     {
+        // Comes before the tables are created, so incremental vacuum applies to new databases without vacuuming them
+        if (configureStorage(db) != 0)
+        {
+            std::cout << "Failed to configure the database" << std::endl;
+        }
+
         // Create Table
         createTable(db);
+        createChangesTable(db);
+        createIdentityTable(db);
+        createReplicationTable(db);
+        createReplicasTable(db);
     };
 
     return db;
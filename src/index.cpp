@@ -0,0 +1,640 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <tuple>
+#include <iterator>
+#include <algorithm>
+
+// struct holding one book of the index
+struct indexedBook {
+    // ID of the row of the book in the fulltext table
+    long long rowId;
+    std::string bookId;
+    std::string bookName;
+    // generation of the last change to the book
+    long long generation;
+    // term id of every word of the text
+    std::vector<uint32_t> tokens;
+    // byte offset of every word in the text, plus one past the end of the text
+    std::vector<uint32_t> offsets;
+
+    // postings: the terms of the book sorted by id, how often each occurs and where its positions start in postingData
+    std::vector<uint32_t> postingTerms;
+    std::vector<uint32_t> postingCounts;
+    std::vector<uint32_t> postingStarts;
+    // the positions of every term, delta and varint encoded
+    std::vector<uint8_t> postingData;
+};
+
+// struct counting in how many books and how often a term occurs, kept up to date when books are indexed or removed
+struct termStats {
+    uint32_t documents = 0;
+    uint64_t occurrences = 0;
+};
+
+// struct holding the normalised words of all books, so searches don't need to read and normalise the texts again
+struct searchIndex {
+    // searches hold it shared, writes to the books exclusively
+    std::shared_timed_mutex mutex;
+    // databaseId of the database the index was built from, and the generation of it the index is up to date with
+    std::string databaseId;
+    long long generation = 0;
+    // vocabulary of normalised words, the id of a term is its position
+    std::vector<std::u32string> terms;
+    std::unordered_map<std::u32string, uint32_t> termIds;
+    // statistics of every term by id, and the number of words of all books
+    std::vector<termStats> stats;
+    uint64_t tokenCount = 0;
+    // number of times the vocabulary was compacted, the term ids change with every compaction
+    long long compactions = 0;
+    // scratch space for building postings, one entry per term
+    std::vector<uint32_t> termSlots;
+    // books by their ID in the fulltext table
+    std::map<long long, indexedBook> books;
+    // IDs of the rows of every bookId
+    std::map<std::string, std::set<long long>> rowIds;
+};
+
+// the index of the database, kept up to date by the write routes
+searchIndex bookIndex;
+
+// struct caching the decoded positions of the most used terms, bounded by the number of positions it holds
+struct postingCache {
+    // identifies the positions of a term in a version of a book: row ID, generation of the book and term id
+    typedef std::tuple<long long, long long, uint32_t> key;
+    typedef std::shared_ptr<const std::vector<uint32_t>> positions;
+
+    std::mutex mutex;
+    size_t maxPositions = 16 * 1024 * 1024;
+    size_t size = 0;
+    // least recently used first
+    std::list<key> order;
+    std::map<key, std::pair<positions, std::list<key>::iterator>> entries;
+
+    long long hits = 0;
+    long long misses = 0;
+};
+
+// only positions of terms occurring at least this often in a book are worth caching, shorter lists decode quickly
+const uint32_t minCachedPositions = 32;
+
+// the cache of the index, shared by all searches
+postingCache hotPostings;
+
+uint32_t getTermId(searchIndex &index, std::u32string term)
+{
+    // Function to get the id of a term, adding it to the vocabulary if it is new
+    // @param: index - the index
+    // @param: term - the normalised word
+    auto found = index.termIds.find(term);
+    if (found != index.termIds.end())
+    {
+        return found->second;
+    }
+
+    uint32_t id = index.terms.size();
+    index.terms.push_back(term);
+    index.stats.emplace_back();
+    index.termIds.emplace(std::move(term), id);
+    return id;
+}
+
+void buildPostings(indexedBook &book, std::vector<uint32_t> &termSlots)
+{
+    // Function to build the postings of a book from its words
+    // Counting the words per term groups the positions without sorting them, only the distinct terms are sorted
+    // @param: book - the book, with its tokens set
+    // @param: termSlots - scratch space with one entry per term of the vocabulary, all set to UINT32_MAX and left that way
+    book.postingTerms.clear();
+    book.postingCounts.clear();
+    book.postingStarts.clear();
+    book.postingData.clear();
+
+    for (auto term : book.tokens)
+    {
+        if (termSlots[term] == UINT32_MAX)
+        {
+            termSlots[term] = 0;
+            book.postingTerms.push_back(term);
+        }
+        termSlots[term]++;
+    }
+    std::sort(book.postingTerms.begin(), book.postingTerms.end());
+
+    // Every term gets a slice of positions, its slot points to the next free position of the slice
+    uint32_t first = 0;
+    for (auto term : book.postingTerms)
+    {
+        book.postingCounts.push_back(termSlots[term]);
+        termSlots[term] = first;
+        first += book.postingCounts.back();
+    }
+
+    std::vector<uint32_t> positions(book.tokens.size());
+    for (uint32_t pos = 0; pos < book.tokens.size(); pos++)
+    {
+        positions[termSlots[book.tokens[pos]]++] = pos;
+    }
+
+    first = 0;
+    for (size_t i = 0; i < book.postingTerms.size(); i++)
+    {
+        book.postingStarts.push_back(book.postingData.size());
+
+        uint32_t previous = 0;
+        for (uint32_t p = first; p < first + book.postingCounts[i]; p++)
+        {
+            // Seven bits per byte, the highest bit marks that more bytes follow
+            uint32_t delta = positions[p] - previous;
+            while (delta >= 0x80)
+            {
+                book.postingData.push_back((delta & 0x7f) | 0x80);
+                delta >>= 7;
+            }
+            book.postingData.push_back(delta);
+            previous = positions[p];
+        }
+        first += book.postingCounts[i];
+
+        termSlots[book.postingTerms[i]] = UINT32_MAX;
+    }
+    book.postingStarts.push_back(book.postingData.size());
+}
+
+std::vector<uint32_t> decodePostings(const indexedBook &book, size_t i)
+{
+    // Function to decode the positions of a term of a book
+    // @param: book - the book
+    // @param: i - the position of the term in book.postingTerms
+    std::vector<uint32_t> positions;
+    positions.reserve(book.postingCounts[i]);
+
+    uint32_t pos = 0;
+    size_t byte = book.postingStarts[i];
+    while (byte < book.postingStarts[i + 1])
+    {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (book.postingData[byte] & 0x80)
+        {
+            delta |= (uint32_t)(book.postingData[byte++] & 0x7f) << shift;
+            shift += 7;
+        }
+        delta |= (uint32_t)book.postingData[byte++] << shift;
+
+        pos += delta;
+        positions.push_back(pos);
+    }
+
+    return positions;
+}
+
+postingCache::positions getPostings(postingCache &cache, const indexedBook &book, size_t i)
+{
+    // Function to get the positions of a term of a book, from the cache if they were decoded recently
+    // @param: cache - the cache
+    // @param: book - the book
+    // @param: i - the position of the term in book.postingTerms
+    if (book.postingCounts[i] < minCachedPositions)
+    {
+        return std::make_shared<const std::vector<uint32_t>>(decodePostings(book, i));
+    }
+
+    postingCache::key key(book.rowId, book.generation, book.postingTerms[i]);
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto found = cache.entries.find(key);
+        if (found != cache.entries.end())
+        {
+            cache.hits++;
+            cache.order.splice(cache.order.end(), cache.order, found->second.second);
+            return found->second.first;
+        }
+        cache.misses++;
+    }
+
+    // Decode without holding the lock, other searches can use the cache in the meantime
+    auto positions = std::make_shared<const std::vector<uint32_t>>(decodePostings(book, i));
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (positions->size() > cache.maxPositions || cache.entries.count(key) > 0)
+    {
+        return positions;
+    }
+
+    while (cache.size + positions->size() > cache.maxPositions)
+    {
+        auto oldest = cache.entries.find(cache.order.front());
+        cache.size -= oldest->second.first->size();
+        cache.entries.erase(oldest);
+        cache.order.pop_front();
+    }
+
+    cache.order.push_back(key);
+    cache.entries[key] = {positions, std::prev(cache.order.end())};
+    cache.size += positions->size();
+
+    return positions;
+}
+
+void clearPostingCache(postingCache &cache)
+{
+    // Function to empty the cache, needed whenever term ids are assigned again
+    // @param: cache - the cache
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.order.clear();
+    cache.entries.clear();
+    cache.size = 0;
+}
+
+void clearIndex(searchIndex &index)
+{
+    // Function to remove everything from the index
+    // @param: index - the index
+    index.databaseId.clear();
+    index.generation = 0;
+    index.terms.clear();
+    index.termIds.clear();
+    index.stats.clear();
+    index.tokenCount = 0;
+    index.termSlots.clear();
+    index.books.clear();
+    index.rowIds.clear();
+    clearPostingCache(hotPostings);
+}
+
+void addIndexedBook(searchIndex &index, long long rowId, indexedBook book)
+{
+    // Function to add a book to the index and count its terms
+    // @param: index - the index
+    // @param: rowId - the ID of the row of the book
+    // @param: book - the book, with its tokens, offsets and postings set
+    book.rowId = rowId;
+
+    for (size_t i = 0; i < book.postingTerms.size(); i++)
+    {
+        auto &stats = index.stats[book.postingTerms[i]];
+        stats.documents++;
+        stats.occurrences += book.postingCounts[i];
+    }
+    index.tokenCount += book.tokens.size();
+
+    index.rowIds[book.bookId].insert(rowId);
+    index.books[rowId] = std::move(book);
+}
+
+void unindexBook(searchIndex &index, long long rowId)
+{
+    // Function to remove a book from the index, its terms stay in the vocabulary
+    // @param: index - the index
+    // @param: rowId - the ID of the row of the book
+    auto found = index.books.find(rowId);
+    if (found == index.books.end())
+    {
+        return;
+    }
+
+    auto &book = found->second;
+    for (size_t i = 0; i < book.postingTerms.size(); i++)
+    {
+        auto &stats = index.stats[book.postingTerms[i]];
+        stats.documents--;
+        stats.occurrences -= book.postingCounts[i];
+    }
+    index.tokenCount -= book.tokens.size();
+
+    auto &rows = index.rowIds[found->second.bookId];
+    rows.erase(rowId);
+    if (rows.size() == 0)
+    {
+        index.rowIds.erase(found->second.bookId);
+    }
+
+    index.books.erase(found);
+}
+
+void indexBook(searchIndex &index, long long rowId, long long generation, std::string bookId, std::string bookName, const std::string &text)
+{
+    // Function to add a book to the index or replace it
+    // @param: index - the index
+    // @param: rowId - the ID of the row of the book
+    // @param: generation - the generation of the last change to the book
+    // @param: bookId - the id of the book
+    // @param: bookName - the name of the book
+    // @param: text - the text of the book
+    unindexBook(index, rowId);
+
+    indexedBook book;
+    book.bookId = std::move(bookId);
+    book.bookName = std::move(bookName);
+    book.generation = generation;
+
+    // Split at single spaces, the same way the texts are cut into periTexts
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = text.find(' ', start);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+
+        book.offsets.push_back(start);
+        book.tokens.push_back(getTermId(index, normaliseWord(text.substr(start, end - start))));
+
+        if (end == text.size())
+        {
+            break;
+        }
+        start = end + 1;
+    }
+    book.offsets.push_back(text.size() + 1);
+
+    index.termSlots.resize(index.terms.size(), UINT32_MAX);
+    buildPostings(book, index.termSlots);
+
+    addIndexedBook(index, rowId, std::move(book));
+}
+
+const indexedBook *findIndexedBook(searchIndex &index, std::string bookId, long long &rowId)
+{
+    // Function to find the first row of a bookId, like getBook does
+    // @param: index - the index
+    // @param: bookId - the id of the book
+    // @param: rowId - set to the ID of the row
+    auto found = index.rowIds.find(bookId);
+    if (found == index.rowIds.end())
+    {
+        return nullptr;
+    }
+
+    rowId = *found->second.begin();
+    return &index.books.at(rowId);
+}
+
+int syncIndexLocked(sqlite3 *db, searchIndex &index)
+{
+    // Function to apply the changes made to the database since the generation of the index
+    // The caller has to hold the mutex of the index exclusively
+    // @param: db - the database
+    // @param: index - the index
+    auto changes = getChangesSince(db, index.generation);
+
+    if (changes.errorCode == 1)
+    {
+        return 1;
+    }
+
+    for (auto &change : changes.results)
+    {
+        long long rowId = std::stoll(change.row[0]);
+        long long generation = std::stoll(change.row[1]);
+
+        auto res = getBookByRowId(db, rowId);
+        if (res.errorCode == 1)
+        {
+            return 1;
+        }
+
+        if (res.results.size() == 0)
+        {
+            // The row was removed
+            unindexBook(index, rowId);
+        }
+        else
+        {
+            auto &row = res.results[0].row;
+            indexBook(index, rowId, generation, std::move(row[1]), std::move(row[2]), row[3]);
+        }
+
+        index.generation = std::max(index.generation, generation);
+    }
+
+    return 0;
+}
+
+int syncIndex(sqlite3 *db, searchIndex &index)
+{
+    // Function to apply the changes made to the database since the generation of the index
+    // @param: db - the database
+    // @param: index - the index
+    std::unique_lock<std::shared_timed_mutex> lock(index.mutex);
+    return syncIndexLocked(db, index);
+}
+
+int rebuildIndex(sqlite3 *db, searchIndex &index)
+{
+    // Function to build the index from scratch, reading the books in small batches
+    // @param: db - the database
+    // @param: index - the index
+    const int batchSize = 16;
+
+    std::unique_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    clearIndex(index);
+
+    // Changes made while reading are applied by the next sync
+    index.databaseId = getDatabaseId(db);
+    index.generation = getGeneration(db);
+    if (index.generation < 0)
+    {
+        return 1;
+    }
+
+    long long rowId = 0;
+    while (true)
+    {
+        auto res = getBooksFrom(db, rowId, batchSize);
+        if (res.errorCode == 1)
+        {
+            return 1;
+        }
+        if (res.results.size() == 0)
+        {
+            break;
+        }
+
+        for (auto &book : res.results)
+        {
+            rowId = std::stoll(book.row[0]);
+            indexBook(index, rowId, index.generation, std::move(book.row[1]), std::move(book.row[2]), book.row[3]);
+        }
+        rowId++;
+    }
+
+    return 0;
+}
+
+size_t countUnusedTerms(searchIndex &index)
+{
+    // Function to count the terms of the vocabulary no book contains anymore
+    // @param: index - the index
+    std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    size_t unused = 0;
+    for (auto &stats : index.stats)
+    {
+        unused += stats.documents == 0;
+    }
+    return unused;
+}
+
+// struct holding the renumbered words of a book until the new term ids are swapped in
+struct compactedBook {
+    // generation of the book when it was renumbered, books changed since are renumbered again
+    long long generation;
+    std::vector<uint32_t> tokens;
+    std::vector<uint32_t> postingTerms;
+};
+
+template <typename Pause>
+size_t compactIndex(searchIndex &index, size_t batchBooks, Pause pause)
+{
+    // Function to drop the terms no book contains anymore from the vocabulary
+    // The remaining terms keep their order, so the postings of every book stay sorted and only the ids change
+    // The books are renumbered in batches holding the index shared, so searches keep running and writes only wait for one batch,
+    // the new ids are swapped in at the end under a short exclusive lock
+    // @param: index - the index
+    // @param: batchBooks - the number of books renumbered per batch
+    // @param: pause - called between batches, returns true to give up the compaction
+    // @return: the number of terms dropped
+    const uint32_t droppedId = UINT32_MAX;
+    size_t termCount;
+    std::vector<uint32_t> newIds;
+    std::vector<std::u32string> terms;
+    std::unordered_map<std::u32string, uint32_t> termIds;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+        termCount = index.terms.size();
+        newIds.resize(termCount, droppedId);
+        for (size_t t = 0; t < termCount; t++)
+        {
+            if (index.stats[t].documents == 0)
+            {
+                continue;
+            }
+            newIds[t] = terms.size();
+            termIds.emplace(index.terms[t], terms.size());
+            terms.push_back(index.terms[t]);
+        }
+    }
+
+    uint32_t kept = terms.size();
+    if (kept == termCount)
+    {
+        return 0;
+    }
+
+    // Terms added while the books are renumbered are appended after the kept ones
+    auto remap = [&newIds, termCount, kept](uint32_t id) {
+        return id < termCount ? newIds[id] : kept + (id - termCount);
+    };
+
+    std::map<long long, compactedBook> compacted;
+    long long nextRowId = 0;
+    bool done = false;
+    while (!done)
+    {
+        if (pause())
+        {
+            return 0;
+        }
+
+        std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+        auto book = index.books.lower_bound(nextRowId);
+        for (size_t i = 0; i < batchBooks && book != index.books.end(); i++, book++)
+        {
+            compactedBook renumbered{book->second.generation, book->second.tokens, book->second.postingTerms};
+            std::transform(renumbered.tokens.begin(), renumbered.tokens.end(), renumbered.tokens.begin(), remap);
+            std::transform(renumbered.postingTerms.begin(), renumbered.postingTerms.end(), renumbered.postingTerms.begin(), remap);
+            compacted[book->first] = std::move(renumbered);
+        }
+        done = book == index.books.end();
+        if (!done)
+        {
+            nextRowId = book->first;
+        }
+    }
+
+    std::unique_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    // A write used a dropped term again, its id can't change anymore
+    for (size_t t = 0; t < termCount; t++)
+    {
+        if (newIds[t] == droppedId && index.stats[t].documents != 0)
+        {
+            return 0;
+        }
+    }
+
+    std::vector<termStats> stats(kept + (index.terms.size() - termCount));
+    for (size_t t = 0; t < index.terms.size(); t++)
+    {
+        if (t >= termCount || newIds[t] != droppedId)
+        {
+            stats[remap(t)] = index.stats[t];
+        }
+    }
+    for (size_t t = termCount; t < index.terms.size(); t++)
+    {
+        termIds.emplace(index.terms[t], terms.size());
+        terms.push_back(std::move(index.terms[t]));
+    }
+
+    for (auto &entry : index.books)
+    {
+        auto &book = entry.second;
+        auto renumbered = compacted.find(entry.first);
+        if (renumbered != compacted.end() && renumbered->second.generation == book.generation &&
+            renumbered->second.tokens.size() == book.tokens.size() && renumbered->second.postingTerms.size() == book.postingTerms.size())
+        {
+            // The old vectors end up in compacted and are freed after the lock is released
+            book.tokens.swap(renumbered->second.tokens);
+            book.postingTerms.swap(renumbered->second.postingTerms);
+            continue;
+        }
+
+        // Added or changed since it was renumbered
+        std::transform(book.tokens.begin(), book.tokens.end(), book.tokens.begin(), remap);
+        std::transform(book.postingTerms.begin(), book.postingTerms.end(), book.postingTerms.begin(), remap);
+    }
+
+    index.terms.swap(terms);
+    index.termIds.swap(termIds);
+    index.stats.swap(stats);
+    index.termSlots.clear();
+    index.compactions++;
+
+    // The cached positions are stored by term id
+    clearPostingCache(hotPostings);
+
+    return termCount - kept;
+}
+
+template <typename Write>
+int writeIndexed(sqlite3 *db, searchIndex &index, Write write)
+{
+    // Function to write to the database and update the index before any search can see the new texts
+    // @param: db - the database
+    // @param: index - the index
+    // @param: write - the write to the database, returning 0 on success
+    // @return: the result of the write, a failed sync doesn't undo a write that was committed
+    std::unique_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    int rc = write();
+    if (syncIndexLocked(db, index) != 0)
+    {
+        // The index stays at the generation it got to, the next write or maintenance pass applies the rest
+        std::cout << "Failed to update the index after a write, searches miss the changes until the next sync" << std::endl;
+    }
+
+    return rc;
+}
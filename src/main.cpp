@@ -8,23 +8,36 @@
 #include <memory>
 #include <cstdlib>
 #include "db.cpp"
+#include "index.cpp"
+#include "snapshot.cpp"
+#include "search.cpp"
+#include "maintenance.cpp"
+#include "admission.cpp"
 #include <restbed>
 #include <nlohmann/json.hpp>
+#include "coordinator.cpp"
+#include "replication.cpp"
 #include <iomanip>
 #include <ctime>
+#include <mutex>
+#include <csignal>
 
 using namespace restbed;
 using json = nlohmann::json;
 
 // create metrics counter
 json metrics;
+std::mutex metricsMutex;
 // Create logging stream
 std::ofstream logFile;
+std::mutex logMutex;
 
 void log(std::string level, std::string message) {
     std::time_t t = std::time(nullptr);
-    std::tm tm = *std::localtime(&t);
+    std::tm tm;
+    localtime_r(&t, &tm);
 
+    std::lock_guard<std::mutex> lock(logMutex);
     logFile << std::put_time(&tm, "%F %T") << " " << level << ": " << message << std::endl;
     return;
 };
@@ -32,6 +45,91 @@ void log(std::string level, std::string message) {
 // make db a global variable to access it inside route handlers
 sqlite3 *db;
 
+// time budget of a search if the request doesn't set timeoutMs, can be changed with FULLTEXT_TIMEOUT_MS
+int defaultTimeoutMs = 10000;
+// largest time budget a request can ask for, leaves room for the slack added when forwarding to shards
+const int maxTimeoutMs = 600000;
+
+int getTimeoutMs(const json &req) {
+    // Function to read the time budget of a request, limited to 0 - maxTimeoutMs
+    // @param: req - the request
+    auto timeoutMs = req.find("timeoutMs");
+    if(timeoutMs == req.end() || !timeoutMs->is_number()) {
+        return defaultTimeoutMs;
+    }
+    // Read as double, so huge values can't overflow
+    return (int)std::min((double)maxTimeoutMs, std::max(0.0, timeoutMs->get<double>()));
+}
+
+// largest page, number of results and surrounding text a search request can ask for
+const int maxPageSize = 1000;
+const int maxSearchResults = 100000;
+const int maxPeriTextLength = 1000;
+
+bool validIntegerField(const json &req, std::string field, int minValue, int maxValue) {
+    // Function to check that a field of a request is either missing or an integer in a range, so reading it as int can't throw or overflow
+    // @param: req - the request
+    // @param: field - the name of the field
+    // @param: minValue - the smallest valid value
+    // @param: maxValue - the largest valid value
+    auto value = req.find(field);
+    if(value == req.end() || value->is_null()) {
+        return true;
+    }
+    // Compared as double, so huge values can't wrap around
+    return value->is_number_integer() && value->get<double>() >= minValue && value->get<double>() <= maxValue;
+}
+
+int validateSearchFields(json &req) {
+    // Function to check the numeric fields of a search request and fill in the defaults of the missing ones
+    // @param: req - the request
+    if(!validIntegerField(req, "pageSize", 1, maxPageSize) || !validIntegerField(req, "maxResults", 0, maxSearchResults) ||
+       !validIntegerField(req, "periTextLength", 0, maxPeriTextLength) || !validIntegerField(req, "timeoutMs", 0, maxTimeoutMs)) {
+        return 1;
+    }
+
+    if(!req["periTextLength"].is_number()) {
+        req["periTextLength"] = 15;
+    }
+    if(!req["maxResults"].is_number()) {
+        req["maxResults"] = 50;
+    }
+    req["timeoutMs"] = getTimeoutMs(req);
+    return 0;
+}
+
+// snapshot of the index, loaded at startup instead of reading and normalising every book again
+const std::string snapshotPath = "./db/fulltext.snapshot";
+snapshotScheduler snapshots;
+
+// background vacuum and compaction of the database and the index
+maintenanceScheduler maintenance;
+
+void countRequest(std::string counter) {
+    // Function to increment a metrics counter, handlers run on several worker threads
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    metrics[counter] = metrics[counter].get<int>() + 1;
+}
+
+// limits of concurrent and queued requests per route, filled before the server starts
+std::map<std::string, std::shared_ptr<routeLimiter>> routeLimiters;
+// seconds clients are told to wait before retrying a shed request
+int retryAfterSeconds = 1;
+
+// shards the requests are forwarded to, only set if the server runs as coordinator
+std::vector<std::shared_ptr<shard>> shards;
+
+// primary the books are replicated from, only set if the server runs as read-only replica
+replicaState replica;
+
+void shedRequest(const std::shared_ptr<Session> session, std::string path, admissionResult result) {
+    // Function to turn a request away because its route is overloaded
+    // A full queue is answered with 429, waiting too long in the queue with 503
+    std::string res = "{\"response\": \"Server is overloaded, try again later. \"}";
+    log("warning", "Shedding request to " + path + ". ");
+    session->close(result == REJECTED_QUEUE_FULL ? 429 : 503, res, {{"Retry-After", std::to_string(retryAfterSeconds)}, {"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+}
+
 std::string getJsonBody(const Bytes &body) {
     // Function to extract string from body, if we pass body.data() to the json parser directly it throws an error
     std::string jsonBody = "";
@@ -50,14 +148,20 @@ void add_handler(const std::shared_ptr<Session> session)
 
     session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
     {
-        metrics["add_count"] = metrics["add_count"].get<int>() + 1;
+        countRequest("add_count");
+
+        admissionTicket ticket(*routeLimiters.at("/add"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/add", ticket.result);
+            return;
+        }
 
         auto req = json::parse(getJsonBody(body));
         std::string res = " ";
 
         if(req["bookId"].is_string() && req["bookName"].is_string() && req["text"].is_string()) {
             log("info", "Add book in sqlite. ");
-            int rc = addBook(db, req["bookId"], req["bookName"], req["text"]);
+            int rc = writeIndexed(db, bookIndex, [&] { return addBook(db, req["bookId"], req["bookName"], req["text"]); });
             if (rc == 0)
             {
                 log("debug", "Saved book to the database. ");
@@ -87,7 +191,13 @@ void edit_handler(const std::shared_ptr<Session> session)
 
     session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
     {
-        metrics["edit_count"] = metrics["edit_count"].get<int>() + 1;
+        countRequest("edit_count");
+
+        admissionTicket ticket(*routeLimiters.at("/edit"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/edit", ticket.result);
+            return;
+        }
 
         auto req = json::parse(getJsonBody(body));
         std::string res = " ";
@@ -109,7 +219,7 @@ void edit_handler(const std::shared_ptr<Session> session)
                 }
             }
             log("info", "Editing book in sqlite. ");
-            int rc = editBook(db, req["bookId"], req["bookName"], req["text"]);
+            int rc = writeIndexed(db, bookIndex, [&] { return editBook(db, req["bookId"], req["bookName"], req["text"]); });
             
             if (rc == 0)
             {
@@ -141,14 +251,20 @@ void remove_handler(const std::shared_ptr<Session> session)
 
     session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
     {
-        metrics["remove_count"] = metrics["remove_count"].get<int>() + 1;
+        countRequest("remove_count");
+
+        admissionTicket ticket(*routeLimiters.at("/remove"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/remove", ticket.result);
+            return;
+        }
 
         auto req = json::parse(getJsonBody(body));
         std::string res = " ";
 
         if(req["bookId"].is_string()) {
             log("info", "Removing book from sqlite. ");
-            int rc = removeBook(db, req["bookId"]);
+            int rc = writeIndexed(db, bookIndex, [&] { return removeBook(db, req["bookId"]); });
 
             if (rc == 0)
             {
@@ -180,10 +296,16 @@ void removeAll_handler(const std::shared_ptr<Session> session)
 
     session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
     {
+        admissionTicket ticket(*routeLimiters.at("/removeAll"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/removeAll", ticket.result);
+            return;
+        }
+
         std::string res = " ";
         
         log("info", "Removing all books from sqlite. ");
-        int rc = removeAllBooks(db);
+        int rc = writeIndexed(db, bookIndex, [&] { return removeAllBooks(db); });
 
         if (rc == 0)
         {
@@ -209,20 +331,54 @@ void search_one_handler(const std::shared_ptr<Session> session)
 
     session->fetch((size_t)length, [](const std::shared_ptr<Session> session, const Bytes &body)
     {
-        metrics["search_one_count"] = metrics["search_one_count"].get<int>() + 1;
+        countRequest("search_one_count");
+
+        admissionTicket ticket(*routeLimiters.at("/search/one"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/search/one", ticket.result);
+            return;
+        }
 
         auto req = json::parse(getJsonBody(body));
         std::string res = " ";
 
-        if(req["bookId"].is_string() && req["searchText"].is_string() && req["stopAfterOne"].is_boolean()) {
-            log("info", "Searching book in sqlite, with term: " + req["searchText"].dump());
-            if(!req["periTextLength"].is_number()) {
-                req["periTextLength"] = 15;
+        if(req["bookId"].is_string() && (req["searchText"].is_string() || req["query"].is_string()) && req["stopAfterOne"].is_boolean() && validateSearchFields(req) == 0) {
+            log("info", "Searching book in sqlite, with term: " + (req["query"].is_string() ? req["query"].dump() : req["searchText"].dump()));
+            if(!req["periText"].is_boolean()) {
+                req["periText"] = true;
             }
-            if(!req["maxResults"].is_number()) {
-                req["maxResults"] = 50;
+            queryNode query;
+            if(req["query"].is_string()) {
+                auto parsed = parseQuery(req["query"]);
+                if(parsed.errorCode != 0) {
+                    log("debug", "Error while parsing query. ");
+                    res = "{\"response\": \"Error while parsing query. \"}";
+                    session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+                    return;
+                }
+                query = parsed.root;
+            } else {
+                query = makePhraseNode(split(req["searchText"], " "));
+            }
+            // Stop searching once the time budget is used up and return what was found until then
+            auto deadline = makeDeadline(req["timeoutMs"]);
+
+            searchResults rc;
+            if(req["pageSize"].is_number()) {
+                // Paginated search, resuming where the cursor of the previous page stopped
+                unsigned long long queryHash = hashQuery("/search/one" + req["bookId"].dump() + req["query"].dump() + req["searchText"].dump());
+                // Single book cursors only use pos and length, -1 starts before the first word
+                searchCursor cursor{0, -1, 0, queryHash};
+                if(req["cursor"].is_string() && decodeCursor(req["cursor"], queryHash, cursor) != 0) {
+                    log("debug", "Error while decoding cursor. ");
+                    res = "{\"response\": \"Error while decoding cursor. \"}";
+                    session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+                    return;
+                }
+                rc = searchBookPage(db, bookIndex, req["bookId"], query, cursor, req["pageSize"], req["periTextLength"], req["periText"], &deadline);
+            } else {
+                rc = searchBookQuery(db, bookIndex, req["bookId"], query, req["stopAfterOne"], req["periTextLength"], req["maxResults"], req["periText"], &deadline);
             }
-            auto rc = searchBook(db, req["bookId"], req["searchText"], req["stopAfterOne"], req["periTextLength"], req["maxResults"]);
 
             if (rc.errorCode == 0)
             {
@@ -230,15 +386,28 @@ void search_one_handler(const std::shared_ptr<Session> session)
 
                 searchRes["results"] = {};
 
-                for(auto sres : rc.results) {
+                for(const auto &sres : rc.results) {
+                    const auto &book = rc.books[sres.book];
                     json searchInfo;
-                    searchInfo["bookId"] = sres.bookId;
-                    searchInfo["bookName"] = sres.bookName;
+                    searchInfo["bookId"] = book.bookId;
+                    searchInfo["bookName"] = book.bookName;
                     searchInfo["word"] = sres.pos;
-                    searchInfo["periText"] = sres.periText;
+                    searchInfo["highlight"] = {sres.start, sres.end};
+                    if(req["periText"].get<bool>()) {
+                        searchInfo["periText"] = getPeriText(rc, sres);
+                    }
                     searchRes["results"].push_back(searchInfo);
                 };
 
+                if(rc.truncated) {
+                    log("warning", "Search ran out of time, returning partial results. ");
+                }
+                searchRes["truncated"] = rc.truncated;
+
+                if(req["pageSize"].is_number()) {
+                    searchRes["nextCursor"] = rc.hasNext ? json(encodeCursor(rc.next)) : json(nullptr);
+                }
+
                 res = searchRes.dump();
             } else {
                 log("error", "Error while searching book in the database. ");
@@ -266,20 +435,53 @@ void search_all_handler(const std::shared_ptr<Session> session)
 
     session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
     {
-        metrics["search_all_count"] = metrics["search_all_count"].get<int>() + 1;
+        countRequest("search_all_count");
+
+        admissionTicket ticket(*routeLimiters.at("/search/all"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/search/all", ticket.result);
+            return;
+        }
 
         auto req = json::parse(getJsonBody(body));
         std::string res = " ";
 
-        if(req["searchText"].is_string() && req["stopAfterOne"].is_boolean()) {
-            log("info", "Searching all books in sqlite, with term: " + req["searchText"].dump());
-            if(!req["periTextLength"].is_number()) {
-                req["periTextLength"] = 15;
+        if((req["searchText"].is_string() || req["query"].is_string()) && req["stopAfterOne"].is_boolean() && validateSearchFields(req) == 0) {
+            log("info", "Searching all books in sqlite, with term: " + (req["query"].is_string() ? req["query"].dump() : req["searchText"].dump()));
+            if(!req["periText"].is_boolean()) {
+                req["periText"] = true;
             }
-            if(!req["maxResults"].is_number()) {
-                req["maxResults"] = 50;
+            queryNode query;
+            if(req["query"].is_string()) {
+                auto parsed = parseQuery(req["query"]);
+                if(parsed.errorCode != 0) {
+                    log("debug", "Error while parsing query. ");
+                    res = "{\"response\": \"Error while parsing query. \"}";
+                    session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+                    return;
+                }
+                query = parsed.root;
+            } else {
+                query = makePhraseNode(split(req["searchText"], " "));
+            }
+            // Stop searching once the time budget is used up and return what was found until then
+            auto deadline = makeDeadline(req["timeoutMs"]);
+
+            searchResults rc;
+            if(req["pageSize"].is_number()) {
+                // Paginated search, resuming where the cursor of the previous page stopped
+                unsigned long long queryHash = hashQuery("/search/all" + req["query"].dump() + req["searchText"].dump());
+                searchCursor cursor{0, 0, 0, queryHash};
+                if(req["cursor"].is_string() && decodeCursor(req["cursor"], queryHash, cursor) != 0) {
+                    log("debug", "Error while decoding cursor. ");
+                    res = "{\"response\": \"Error while decoding cursor. \"}";
+                    session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+                    return;
+                }
+                rc = searchAllBooksPage(db, bookIndex, query, cursor, req["pageSize"], req["periTextLength"], req["periText"], &deadline);
+            } else {
+                rc = searchAllBooksQuery(db, bookIndex, query, req["stopAfterOne"], req["periTextLength"], req["maxResults"], req["periText"], &deadline);
             }
-            auto rc = searchAllBooks(db, req["searchText"], req["stopAfterOne"], req["periTextLength"], req["maxResults"]);
             
             if (rc.errorCode == 0)
             {
@@ -287,15 +489,28 @@ void search_all_handler(const std::shared_ptr<Session> session)
 
                 searchRes["results"] = {};
 
-                for(auto sres : rc.results) {
+                for(const auto &sres : rc.results) {
+                    const auto &book = rc.books[sres.book];
                     json searchInfo;
-                    searchInfo["bookId"] = sres.bookId;
-                    searchInfo["bookName"] = sres.bookName;
+                    searchInfo["bookId"] = book.bookId;
+                    searchInfo["bookName"] = book.bookName;
                     searchInfo["word"] = sres.pos;
-                    searchInfo["periText"] = sres.periText;
+                    searchInfo["highlight"] = {sres.start, sres.end};
+                    if(req["periText"].get<bool>()) {
+                        searchInfo["periText"] = getPeriText(rc, sres);
+                    }
                     searchRes["results"].push_back(searchInfo);
                 };
 
+                if(rc.truncated) {
+                    log("warning", "Search ran out of time, returning partial results. ");
+                }
+                searchRes["truncated"] = rc.truncated;
+
+                if(req["pageSize"].is_number()) {
+                    searchRes["nextCursor"] = rc.hasNext ? json(encodeCursor(rc.next)) : json(nullptr);
+                }
+
                 res = searchRes.dump();
             } else {
                 log("error", "Error while searching books in the database. ");
@@ -314,6 +529,240 @@ void search_all_handler(const std::shared_ptr<Session> session)
     });
 };
 
+void closeWithShardResponse(const std::shared_ptr<Session> session, instanceResponse response, std::string error) {
+    // Function to answer a request with the answer of a shard, or with an error if there is none
+    if(response.errorCode != 0) {
+        log("error", error);
+        std::string res = "{\"response\": \"" + error + "\"}";
+        session->close(500, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+        return;
+    }
+    if(isShedResponse(response)) {
+        // Pass on how long the overloaded shard asked to wait
+        log("warning", "Shard is overloaded, shedding request. ");
+        std::string retryAfter = response.retryAfter.empty() ? std::to_string(retryAfterSeconds) : response.retryAfter;
+        session->close(response.status, response.body, {{"Retry-After", retryAfter}, {"Content-Length", std::to_string(response.body.size())}, {"Content-type", "application/json"}});
+        return;
+    }
+    session->close(response.status, response.body, {{"Content-Length", std::to_string(response.body.size())}, {"Content-type", "application/json"}});
+}
+
+std::function<void(const std::shared_ptr<Session>)> coordinator_book_handler(std::string path, std::string counter)
+{
+    // Handler of the routes working on a single book, they are forwarded to the shard owning the book
+    return [path, counter](const std::shared_ptr<Session> session) {
+        const auto request = session->get_request();
+
+        auto length = 0;
+        request->get_header("Content-Length", length);
+
+        session->fetch(length, [path, counter](const std::shared_ptr<Session> session, const Bytes &body)
+        {
+            countRequest(counter);
+
+            admissionTicket ticket(*routeLimiters.at(path));
+            if(ticket.result != ADMITTED) {
+                shedRequest(session, path, ticket.result);
+                return;
+            }
+
+            auto req = json::parse(getJsonBody(body));
+            std::string res = " ";
+
+            if(req["bookId"].is_string()) {
+                // Every book lives on exactly one shard, picked by its bookId
+                auto &owner = *shards[getShardIndex(req["bookId"], shards.size())];
+                log("info", "Forwarding request to " + path + " to shard " + owner.url + ". ");
+
+                closeWithShardResponse(session, forwardToShard(owner, path, getJsonBody(body), getTimeoutMs(req) + 1000), "Error while forwarding request to shard. ");
+            } else {
+                log("debug", "Error while validating input. ");
+                res = "{\"response\": \"Error while validating input. \"}";
+                session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+            }
+        });
+    };
+};
+
+void coordinator_removeAll_handler(const std::shared_ptr<Session> session)
+{
+    const auto request = session->get_request();
+
+    auto length = 0;
+    request->get_header("Content-Length", length);
+
+    session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
+    {
+        admissionTicket ticket(*routeLimiters.at("/removeAll"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/removeAll", ticket.result);
+            return;
+        }
+
+        std::string res = " ";
+
+        log("info", "Removing all books from all shards. ");
+        for(auto &response : forwardToAllShards(shards, "/removeAll", "{}", defaultTimeoutMs)) {
+            if(isShedResponse(response)) {
+                closeWithShardResponse(session, response, "Error while removing all books from the shards. ");
+                return;
+            }
+            if(response.errorCode != 0 || response.status != OK) {
+                log("error", "Error while removing all books from the shards. ");
+                res = "{\"response\": \"Error while removing all books from the shards. \"}";
+                session->close(500, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+                return;
+            }
+        }
+
+        res = "{\"response\": \"Removed all books from the database. \"}";
+        session->close(OK, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+    });
+};
+
+void coordinator_search_all_handler(const std::shared_ptr<Session> session)
+{
+    const auto request = session->get_request();
+
+    auto length = 0;
+    request->get_header("Content-Length", length);
+
+    session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
+    {
+        countRequest("search_all_count");
+
+        admissionTicket ticket(*routeLimiters.at("/search/all"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/search/all", ticket.result);
+            return;
+        }
+
+        auto req = json::parse(getJsonBody(body));
+        std::string res = " ";
+
+        if((req["searchText"].is_string() || req["query"].is_string()) && req["stopAfterOne"].is_boolean() && validateSearchFields(req) == 0) {
+            log("info", "Searching all shards, with term: " + (req["query"].is_string() ? req["query"].dump() : req["searchText"].dump()));
+            if(!req["periText"].is_boolean()) {
+                req["periText"] = true;
+            }
+
+            instanceResponse rc;
+            if(req["pageSize"].is_number()) {
+                // Paginated search, the cursor remembers the shard and the cursor of that shard
+                unsigned long long queryHash = hashQuery("/search/all" + req["query"].dump() + req["searchText"].dump());
+                shardCursor cursor{0, "", queryHash};
+                if(req["cursor"].is_string() && decodeShardCursor(req["cursor"], queryHash, shards.size(), cursor) != 0) {
+                    log("debug", "Error while decoding cursor. ");
+                    res = "{\"response\": \"Error while decoding cursor. \"}";
+                    session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+                    return;
+                }
+                rc = searchShardsPage(shards, req, cursor, req["pageSize"], req["timeoutMs"]);
+            } else {
+                rc = searchAllShards(shards, req, req["timeoutMs"]);
+            }
+
+            closeWithShardResponse(session, rc, "Error while searching books in the shards. ");
+        } else {
+            log("debug", "Error while validating input. ");
+            res = "{\"response\": \"Error while validating input. \"}";
+            session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+        }
+    });
+};
+
+void changes_handler(const std::shared_ptr<Session> session)
+{
+    const auto request = session->get_request();
+
+    auto length = 0;
+    request->get_header("Content-Length", length);
+
+    session->fetch(length, [](const std::shared_ptr<Session> session, const Bytes &body)
+    {
+        admissionTicket ticket(*routeLimiters.at("/changes"));
+        if(ticket.result != ADMITTED) {
+            shedRequest(session, "/changes", ticket.result);
+            return;
+        }
+
+        auto req = json::parse(getJsonBody(body));
+        std::string res = " ";
+
+        if(req["since"].is_number()) {
+            if(!req["limit"].is_number()) {
+                req["limit"] = 64;
+            }
+
+            long long generation;
+            SQLResults rc;
+            std::string databaseId;
+            long long prunedGeneration;
+            {
+                // Holds the index shared, so nothing here ends up inside the transaction of a write or reads its uncommitted rows
+                std::shared_lock<std::shared_timed_mutex> lock(bookIndex.mutex);
+
+                // The replica applied everything up to since, removals before it can be pruned
+                if(req["replica"].is_string() && req["replica"] != "") {
+                    if(recordReplica(db, req["replica"], req["since"]) != 0) {
+                        log("error", "Error while recording the replica. ");
+                    }
+                }
+
+                // Read the generation first, so it is never ahead of the changes a replica applied
+                generation = getGeneration(db);
+                rc = getChangeLog(db, req["since"], std::min(1024, std::max(1, req["limit"].get<int>())));
+                databaseId = getDatabaseId(db);
+                // Read after the changes, removals pruned before them are always included
+                prunedGeneration = getPrunedGeneration(db);
+            }
+
+            if (generation >= 0 && rc.errorCode == 0 && databaseId != "" && prunedGeneration >= 0)
+            {
+                json changeLog;
+                changeLog["generation"] = generation;
+                changeLog["databaseId"] = databaseId;
+                changeLog["prunedGeneration"] = prunedGeneration;
+                changeLog["changes"] = json::array();
+
+                for(const auto &row : rc.results) {
+                    json change;
+                    change["generation"] = std::stoll(row.row[0]);
+                    change["rowId"] = std::stoll(row.row[1]);
+                    change["removed"] = row.row[2] == "1";
+                    if(row.row[2] != "1") {
+                        change["bookId"] = row.row[3];
+                        change["bookName"] = row.row[4];
+                        change["text"] = row.row[5];
+                    }
+                    changeLog["changes"].push_back(change);
+                }
+
+                res = changeLog.dump();
+            } else {
+                log("error", "Error while reading the change log. ");
+                res = "{\"response\": \"Error while reading the change log. \"}";
+                session->close(500, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+                return;
+            }
+        } else {
+            log("debug", "Error while validating input. ");
+            res = "{\"response\": \"Error while validating input. \"}";
+            session->close(400, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+            return;
+        }
+
+        session->close(OK, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+    });
+};
+
+void replica_write_handler(const std::shared_ptr<Session> session)
+{
+    // Replicas only apply the change log of their primary, writes have to go to the primary
+    std::string res = "{\"response\": \"This instance is a read-only replica, send writes to the primary. \"}";
+    session->close(403, res, {{"Content-Length", std::to_string(res.size())}, {"Content-type", "application/json"}});
+};
+
 void metrics_handler(const std::shared_ptr<Session> session)
 {
     const auto request = session->get_request();
@@ -325,11 +774,74 @@ void metrics_handler(const std::shared_ptr<Session> session)
     {
         std::string res = "";
 
+        std::unique_lock<std::mutex> lock(metricsMutex);
         res += "http_request_duration_seconds_count{path=\"/add\",project_name=\"fts\"} " + metrics["add_count"].dump() + "\n";
         res += "http_request_duration_seconds_count{path=\"/edit\",project_name=\"fts\"} " + metrics["edit_count"].dump() + "\n";
         res += "http_request_duration_seconds_count{path=\"/remove\",project_name=\"fts\"} " + metrics["remove_count"].dump() + "\n";
         res += "http_request_duration_seconds_count{path=\"/search/all\",project_name=\"fts\"} " + metrics["search_all_count"].dump() + "\n";
         res += "http_request_duration_seconds_count{path=\"/search/one\",project_name=\"fts\"} " + metrics["search_one_count"].dump() + "\n";
+        lock.unlock();
+
+        // admission control per route
+        res += "\n";
+        for(auto &route : routeLimiters) {
+            auto stats = getLimiterStats(*route.second);
+            std::string labels = "{path=\"" + route.first + "\",project_name=\"fts\"";
+            res += "fulltext_active_requests" + labels + "} " + std::to_string(stats.active) + "\n";
+            res += "fulltext_queue_depth" + labels + "} " + std::to_string(stats.queued) + "\n";
+            res += "fulltext_rejected_requests_total" + labels + ",reason=\"queue_full\"} " + std::to_string(stats.rejectedQueueFull) + "\n";
+            res += "fulltext_rejected_requests_total" + labels + ",reason=\"timeout\"} " + std::to_string(stats.rejectedTimeout) + "\n";
+        }
+
+        // positions of the hottest terms
+        if(shards.size() == 0) {
+            std::lock_guard<std::mutex> cacheLock(hotPostings.mutex);
+            res += "\nfulltext_posting_cache_hits_total{project_name=\"fts\"} " + std::to_string(hotPostings.hits) + "\n";
+            res += "fulltext_posting_cache_misses_total{project_name=\"fts\"} " + std::to_string(hotPostings.misses) + "\n";
+            res += "fulltext_posting_cache_positions{project_name=\"fts\"} " + std::to_string(hotPostings.size) + "\n";
+        }
+
+        // maintenance of the database and the index
+        if(shards.size() == 0) {
+            auto stats = getMaintenanceStats(maintenance);
+            res += "\nfulltext_maintenance_running{project_name=\"fts\"} " + std::to_string(stats.running ? 1 : 0) + "\n";
+            res += "fulltext_maintenance_reclaimed_pages{project_name=\"fts\"} " + std::to_string(stats.reclaimedPages) + "\n";
+            res += "fulltext_maintenance_free_pages{project_name=\"fts\"} " + std::to_string(stats.freePages) + "\n";
+            res += "fulltext_maintenance_passes_total{project_name=\"fts\"} " + std::to_string(stats.passes) + "\n";
+            res += "fulltext_maintenance_errors_total{project_name=\"fts\"} " + std::to_string(stats.errors) + "\n";
+            res += "fulltext_maintenance_last_pass_timestamp_seconds{project_name=\"fts\"} " + std::to_string(stats.lastPassEnd) + "\n";
+            res += "fulltext_maintenance_last_pass_duration_seconds{project_name=\"fts\"} " + std::to_string(stats.lastPassSeconds) + "\n";
+            res += "fulltext_maintenance_last_checkpointed_pages{project_name=\"fts\"} " + std::to_string(stats.lastCheckpointedPages) + "\n";
+            res += "fulltext_maintenance_last_reclaimed_pages{project_name=\"fts\"} " + std::to_string(stats.lastReclaimedPages) + "\n";
+            res += "fulltext_maintenance_last_dropped_terms{project_name=\"fts\"} " + std::to_string(stats.lastDroppedTerms) + "\n";
+            res += "fulltext_maintenance_last_pruned_changes{project_name=\"fts\"} " + std::to_string(stats.lastPrunedChanges) + "\n";
+        }
+
+        // replication
+        if(shards.size() == 0) {
+            // A replica may have a transaction open on the connection, only read committed changes
+            std::shared_lock<std::shared_timed_mutex> lock(bookIndex.mutex);
+            res += "\nfulltext_generation{project_name=\"fts\"} " + std::to_string(getGeneration(db)) + "\n";
+        }
+        if(replica.primaryUrl.size() > 0) {
+            auto stats = getReplicationStats(replica);
+            res += "fulltext_replication_applied_generation{project_name=\"fts\"} " + std::to_string(stats.appliedGeneration) + "\n";
+            res += "fulltext_replication_primary_generation{project_name=\"fts\"} " + std::to_string(stats.primaryGeneration) + "\n";
+            res += "fulltext_replication_lag_generations{project_name=\"fts\"} " + std::to_string(stats.primaryGeneration - stats.appliedGeneration) + "\n";
+            res += "fulltext_replication_lag_seconds{project_name=\"fts\"} " + std::to_string(stats.lagSeconds) + "\n";
+            res += "fulltext_replication_errors_total{project_name=\"fts\"} " + std::to_string(stats.errors) + "\n";
+        }
+
+        // shards of the coordinator
+        if(shards.size() > 0) {
+            res += "\n";
+        }
+        for(auto &s : shards) {
+            std::lock_guard<std::mutex> shardLock(s->mutex);
+            std::string labels = "{shard=\"" + s->url + "\",project_name=\"fts\"}";
+            res += "fulltext_shard_requests_total" + labels + " " + std::to_string(s->requests) + "\n";
+            res += "fulltext_shard_errors_total" + labels + " " + std::to_string(s->errors) + "\n";
+        }
 
         res += "\nup{project_name=\"fts\"} 1";
 
@@ -339,46 +851,127 @@ void metrics_handler(const std::shared_ptr<Session> session)
 
 int main(const int, const char **)
 {
-    db = initDB();
+    if(std::getenv("FULLTEXT_TIMEOUT_MS") != nullptr) {
+        defaultTimeoutMs = std::min(maxTimeoutMs, std::max(0, std::atoi(std::getenv("FULLTEXT_TIMEOUT_MS"))));
+    }
+
+    // Run as coordinator of the shards in FULLTEXT_SHARDS instead of storing books
+    if(std::getenv("FULLTEXT_SHARDS") != nullptr && parseShards(std::getenv("FULLTEXT_SHARDS"), shards) != 0) {
+        std::cout << "Invalid FULLTEXT_SHARDS" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(shards.size() > 0) {
+        std::cout << "Coordinating " << shards.size() << " shards" << std::endl;
+    } else {
+        db = initDB();
+
+        if(std::getenv("FULLTEXT_POSTING_CACHE_MB") != nullptr) {
+            hotPostings.maxPositions = std::max(0, std::atoi(std::getenv("FULLTEXT_POSTING_CACHE_MB"))) * (size_t)1024 * 1024 / sizeof(uint32_t);
+        }
+
+        // Load the index from the last snapshot, or build it from the database
+        if(initIndex(db, bookIndex, snapshotPath) != 0) {
+            std::cout << "Failed to build the index" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        int snapshotIntervalSeconds = 300;
+        if(std::getenv("FULLTEXT_SNAPSHOT_INTERVAL_S") != nullptr) {
+            snapshotIntervalSeconds = std::max(1, std::atoi(std::getenv("FULLTEXT_SNAPSHOT_INTERVAL_S")));
+        }
+        startSnapshots(bookIndex, snapshotPath, snapshotIntervalSeconds, snapshots);
+
+        if(std::getenv("FULLTEXT_MAINTENANCE_INTERVAL_S") != nullptr) {
+            maintenance.intervalSeconds = std::max(1, std::atoi(std::getenv("FULLTEXT_MAINTENANCE_INTERVAL_S")));
+        }
+        if(std::getenv("FULLTEXT_MAINTENANCE_PAGES_PER_S") != nullptr) {
+            maintenance.pagesPerSecond = std::max(1, std::atoi(std::getenv("FULLTEXT_MAINTENANCE_PAGES_PER_S")));
+        }
+        if(std::getenv("FULLTEXT_MAINTENANCE_CPU_PERCENT") != nullptr) {
+            maintenance.cpuPercent = std::min(100, std::max(1, std::atoi(std::getenv("FULLTEXT_MAINTENANCE_CPU_PERCENT"))));
+        }
+        if(std::getenv("FULLTEXT_REPLICA_RETENTION_S") != nullptr) {
+            maintenance.replicaRetentionSeconds = std::max(0, std::atoi(std::getenv("FULLTEXT_REPLICA_RETENTION_S")));
+        }
+        startMaintenance(db, bookIndex, maintenance);
+
+        // Follow the change log of FULLTEXT_PRIMARY as read-only replica
+        if(std::getenv("FULLTEXT_PRIMARY") != nullptr) {
+            replica.primaryUrl = std::getenv("FULLTEXT_PRIMARY");
+            replica.pollMs = 1000;
+            if(std::getenv("FULLTEXT_REPLICATION_POLL_MS") != nullptr) {
+                replica.pollMs = std::max(1, std::atoi(std::getenv("FULLTEXT_REPLICATION_POLL_MS")));
+            }
+            std::cout << "Replicating from " << replica.primaryUrl << std::endl;
+            startReplication(db, bookIndex, replica);
+        }
+    }
+
+    // Coordinators forward every route to the shards, replicas reject writes
+    std::map<std::string, std::function<void(const std::shared_ptr<Session>)>> handlers = {
+        {"/add", add_handler}, {"/edit", edit_handler}, {"/remove", remove_handler}, {"/removeAll", removeAll_handler},
+        {"/search/one", search_one_handler}, {"/search/all", search_all_handler}};
+    if(shards.size() > 0) {
+        handlers["/add"] = coordinator_book_handler("/add", "add_count");
+        handlers["/edit"] = coordinator_book_handler("/edit", "edit_count");
+        handlers["/remove"] = coordinator_book_handler("/remove", "remove_count");
+        handlers["/removeAll"] = coordinator_removeAll_handler;
+        handlers["/search/one"] = coordinator_book_handler("/search/one", "search_one_count");
+        handlers["/search/all"] = coordinator_search_all_handler;
+    } else if(replica.primaryUrl.size() > 0) {
+        handlers["/add"] = replica_write_handler;
+        handlers["/edit"] = replica_write_handler;
+        handlers["/remove"] = replica_write_handler;
+        handlers["/removeAll"] = replica_write_handler;
+    }
 
     Service service;
 
     // Route to add text
     auto add_resource = std::make_shared<Resource>();
     add_resource->set_path("/add");
-    add_resource->set_method_handler("POST", add_handler);
+    add_resource->set_method_handler("POST", handlers["/add"]);
     service.publish(add_resource);
 
     // route to edit text
     auto edit_resource = std::make_shared<Resource>();
     edit_resource->set_path("/edit");
-    edit_resource->set_method_handler("POST", edit_handler);
+    edit_resource->set_method_handler("POST", handlers["/edit"]);
     service.publish(edit_resource);
 
     // route to remove text
     auto remove_resource = std::make_shared<Resource>();
     remove_resource->set_path("/remove");
-    remove_resource->set_method_handler("POST", remove_handler);
+    remove_resource->set_method_handler("POST", handlers["/remove"]);
     service.publish(remove_resource);
 
     // route to remove all texts
     auto removeAll_resource = std::make_shared<Resource>();
     removeAll_resource->set_path("/removeAll");
-    removeAll_resource->set_method_handler("POST", removeAll_handler);
+    removeAll_resource->set_method_handler("POST", handlers["/removeAll"]);
     service.publish(removeAll_resource);
 
     // route to search text in one book
     auto search_one_resource = std::make_shared<Resource>();
     search_one_resource->set_path("/search/one");
-    search_one_resource->set_method_handler("POST", search_one_handler);
+    search_one_resource->set_method_handler("POST", handlers["/search/one"]);
     service.publish(search_one_resource);
     
     // route to search text in all books
     auto search_all_resource = std::make_shared<Resource>();
     search_all_resource->set_path("/search/all");
-    search_all_resource->set_method_handler("POST", search_all_handler);
+    search_all_resource->set_method_handler("POST", handlers["/search/all"]);
     service.publish(search_all_resource);
 
+    // route to read the change log, followed by replicas
+    auto changes_resource = std::make_shared<Resource>();
+    changes_resource->set_path("/changes");
+    changes_resource->set_method_handler("POST", changes_handler);
+    if(shards.size() == 0) {
+        service.publish(changes_resource);
+    }
+
     // route to search text in all books
     auto metrics_resource = std::make_shared<Resource>();
     metrics_resource->set_path("/metrics");
@@ -386,11 +979,48 @@ int main(const int, const char **)
     service.publish(metrics_resource);
     
 
+    // Limit concurrent and queued requests per route, so expensive searches can't starve the cheap routes
+    int queueTimeoutMs = 1000;
+    if(std::getenv("FULLTEXT_QUEUE_TIMEOUT_MS") != nullptr) {
+        queueTimeoutMs = std::atoi(std::getenv("FULLTEXT_QUEUE_TIMEOUT_MS"));
+    }
+    if(std::getenv("FULLTEXT_RETRY_AFTER") != nullptr) {
+        retryAfterSeconds = std::atoi(std::getenv("FULLTEXT_RETRY_AFTER"));
+    }
+    routeLimiters["/add"] = makeLimiter(4, 16, queueTimeoutMs);
+    routeLimiters["/edit"] = makeLimiter(4, 16, queueTimeoutMs);
+    routeLimiters["/remove"] = makeLimiter(4, 16, queueTimeoutMs);
+    routeLimiters["/removeAll"] = makeLimiter(1, 0, queueTimeoutMs);
+    routeLimiters["/search/one"] = makeLimiter(8, 16, queueTimeoutMs);
+    routeLimiters["/search/all"] = makeLimiter(2, 4, queueTimeoutMs);
+    if(shards.size() == 0) {
+        routeLimiters["/changes"] = makeLimiter(2, 4, queueTimeoutMs);
+    }
+    std::string invalidRouteLimit;
+    if(std::getenv("FULLTEXT_ROUTE_LIMITS") != nullptr && parseRouteLimits(std::getenv("FULLTEXT_ROUTE_LIMITS"), queueTimeoutMs, routeLimiters, invalidRouteLimit) != 0) {
+        std::cout << "Invalid FULLTEXT_ROUTE_LIMITS entry \"" << invalidRouteLimit << "\", expected a published route as path=concurrency:queue" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Every admitted or queued request holds a worker, plus one for /metrics
+    unsigned int workers = 1;
+    for(auto &route : routeLimiters) {
+        workers += route.second->maxConcurrent + route.second->maxQueued;
+    }
+
     // Set up server
     auto settings = std::make_shared<Settings>();
     settings->set_port(1984);
+    if(std::getenv("FULLTEXT_PORT") != nullptr) {
+        settings->set_port(std::atoi(std::getenv("FULLTEXT_PORT")));
+    }
+    settings->set_worker_limit(workers);
     settings->set_default_header("Connection", "close");
 
+    // Stop cleanly on SIGINT and SIGTERM, so a last snapshot is written
+    service.set_signal_handler(SIGINT, [&service](const int) { service.stop(); });
+    service.set_signal_handler(SIGTERM, [&service](const int) { service.stop(); });
+
     // initialise metrics counter
     metrics["add_count"] = 0;
     metrics["edit_count"] = 0;
@@ -405,7 +1035,12 @@ int main(const int, const char **)
     std::cout << "Starting server on port: " << settings->get_port() << std::endl;;
     service.start(settings);
 
-    deinitDB(db);
+    if(shards.size() == 0) {
+        stopMaintenance(maintenance);
+        stopReplication(replica);
+        stopSnapshots(bookIndex, snapshotPath, snapshots);
+        deinitDB(db);
+    }
 
     return EXIT_SUCCESS;
 };
\ No newline at end of file
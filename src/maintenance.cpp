@@ -0,0 +1,252 @@
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <ctime>
+#include <algorithm>
+
+// number of books renumbered per step when the vocabulary is compacted
+const size_t compactionBatchBooks = 64;
+
+// struct controlling the thread which keeps the database and the index compact
+struct maintenanceScheduler {
+    // time between two passes
+    int intervalSeconds = 3600;
+    // I/O budget: database pages checkpointed or reclaimed per second
+    int pagesPerSecond = 1024;
+    // CPU budget: share of the time the thread is allowed to be busy, in percent
+    int cpuPercent = 10;
+    // how long removals are kept for a replica that stopped asking for changes
+    int replicaRetentionSeconds = 7 * 24 * 3600;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop = false;
+
+    // progress of the running pass
+    bool running = false;
+    long long reclaimedPages = 0;
+    long long freePages = 0;
+
+    // results of the last complete pass
+    long long passes = 0;
+    long long errors = 0;
+    std::time_t lastPassEnd = 0;
+    double lastPassSeconds = 0;
+    long long lastCheckpointedPages = 0;
+    long long lastReclaimedPages = 0;
+    long long lastDroppedTerms = 0;
+    long long lastPrunedChanges = 0;
+};
+
+// struct to make reading the state of the maintenance for metrics easier
+struct maintenanceStats {
+    bool running;
+    long long reclaimedPages;
+    long long freePages;
+    long long passes;
+    long long errors;
+    std::time_t lastPassEnd;
+    double lastPassSeconds;
+    long long lastCheckpointedPages;
+    long long lastReclaimedPages;
+    long long lastDroppedTerms;
+    long long lastPrunedChanges;
+};
+
+bool throttleMaintenance(maintenanceScheduler &scheduler, std::chrono::steady_clock::time_point stepStart, long long pages)
+{
+    // Function to wait after a step of a pass until the pass is back within its budgets
+    // @param: scheduler - the scheduler running the pass
+    // @param: stepStart - when the step started
+    // @param: pages - the number of pages the step wrote
+    // @return: true if the thread has to stop
+    std::chrono::duration<double> busy = std::chrono::steady_clock::now() - stepStart;
+    int cpuPercent = std::min(100, std::max(1, scheduler.cpuPercent));
+
+    // Idle long enough for the step to take cpuPercent of the time, and long enough to write no more than pagesPerSecond
+    auto cpuWait = busy * (100 - cpuPercent) / cpuPercent;
+    auto ioWait = std::chrono::duration<double>((double)pages / std::max(1, scheduler.pagesPerSecond)) - busy;
+
+    std::unique_lock<std::mutex> lock(scheduler.mutex);
+    return scheduler.wake.wait_for(lock, std::max(cpuWait, ioWait), [&scheduler] { return scheduler.stop; });
+}
+
+int runMaintenance(sqlite3 *db, searchIndex &index, maintenanceScheduler &scheduler)
+{
+    // Function to run one pass: bring the index up to date, prune the change log, reclaim the free pages of the database step by step, checkpoint the write-ahead log and compact the index
+    // The database steps hold the index shared, so they never end up inside the transaction of a write
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: scheduler - the scheduler running the pass
+    // @return: 0 once the pass is done or the thread has to stop, 1 on errors
+    auto passStart = std::chrono::steady_clock::now();
+
+    // Catches up on changes a failed sync after a write left out of the index
+    if (syncIndex(db, index) != 0)
+    {
+        std::lock_guard<std::mutex> lock(scheduler.mutex);
+        scheduler.errors++;
+        return 1;
+    }
+
+    long long prunedChanges;
+    long long freePages;
+    {
+        // Pruned first, so its pages are reclaimed by the same pass
+        std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+        prunedChanges = pruneChangeLog(db, scheduler.replicaRetentionSeconds);
+        freePages = getPragmaValue(db, "freelist_count");
+    }
+    {
+        std::lock_guard<std::mutex> lock(scheduler.mutex);
+        scheduler.running = true;
+        scheduler.reclaimedPages = 0;
+        scheduler.freePages = std::max(0LL, freePages);
+    }
+
+    int rc = prunedChanges < 0 || freePages < 0 ? 1 : 0;
+    bool stopped = false;
+    int walPages = 0;
+    int checkpointedPages = 0;
+    long long reclaimedPages = 0;
+    size_t droppedTerms = 0;
+    auto stepStart = std::chrono::steady_clock::now();
+
+    // Small steps, so writes never wait long for the index
+    int stepPages = std::max(1, scheduler.pagesPerSecond / 10);
+    while (rc == 0 && !stopped && freePages > 0)
+    {
+        stepStart = std::chrono::steady_clock::now();
+        long long freed;
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+            freed = incrementalVacuum(db, stepPages);
+            freePages = getPragmaValue(db, "freelist_count");
+        }
+        if (freed < 0 || freePages < 0)
+        {
+            rc = 1;
+            break;
+        }
+        reclaimedPages += freed;
+
+        {
+            std::lock_guard<std::mutex> lock(scheduler.mutex);
+            scheduler.reclaimedPages = reclaimedPages;
+            scheduler.freePages = std::max(0LL, freePages);
+        }
+
+        if (freed == 0)
+        {
+            break;
+        }
+        stopped = throttleMaintenance(scheduler, stepStart, freed);
+    }
+
+    // The file only shrinks once the vacuumed pages are copied out of the log
+    if (rc == 0 && !stopped)
+    {
+        stepStart = std::chrono::steady_clock::now();
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+            rc = checkpointWAL(db, walPages, checkpointedPages);
+        }
+        stopped = throttleMaintenance(scheduler, stepStart, checkpointedPages);
+    }
+
+    // Edits and removals leave terms behind no book contains anymore, only worth dropping once there are many
+    if (rc == 0 && !stopped)
+    {
+        stepStart = std::chrono::steady_clock::now();
+        size_t termCount;
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+            termCount = index.terms.size();
+        }
+        size_t unusedTerms = countUnusedTerms(index);
+        if (unusedTerms > 0 && unusedTerms * 4 >= termCount)
+        {
+            droppedTerms = compactIndex(index, compactionBatchBooks, [&scheduler, &stepStart, &stopped]() {
+                stopped = throttleMaintenance(scheduler, stepStart, 0);
+                stepStart = std::chrono::steady_clock::now();
+                return stopped;
+            });
+        }
+        if (!stopped)
+        {
+            stopped = throttleMaintenance(scheduler, stepStart, 0);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(scheduler.mutex);
+    scheduler.running = false;
+    if (rc != 0)
+    {
+        scheduler.errors++;
+    }
+    else if (!stopped)
+    {
+        scheduler.passes++;
+        scheduler.lastPassEnd = std::time(nullptr);
+        scheduler.lastPassSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - passStart).count();
+        scheduler.lastCheckpointedPages = checkpointedPages;
+        scheduler.lastReclaimedPages = reclaimedPages;
+        scheduler.lastDroppedTerms = droppedTerms;
+        scheduler.lastPrunedChanges = prunedChanges;
+    }
+
+    return rc;
+}
+
+void startMaintenance(sqlite3 *db, searchIndex &index, maintenanceScheduler &scheduler)
+{
+    // Function to start running a maintenance pass every intervalSeconds
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: scheduler - the scheduler to run the thread on
+    scheduler.thread = std::thread([db, &index, &scheduler]() {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(scheduler.mutex);
+                if (scheduler.wake.wait_for(lock, std::chrono::seconds(scheduler.intervalSeconds), [&scheduler] { return scheduler.stop; }))
+                {
+                    break;
+                }
+            }
+
+            if (runMaintenance(db, index, scheduler) != 0)
+            {
+                std::cout << "Database maintenance failed" << std::endl;
+            }
+        }
+    });
+}
+
+void stopMaintenance(maintenanceScheduler &scheduler)
+{
+    // Function to stop the maintenance thread, a running pass stops after its current step
+    // @param: scheduler - the scheduler running the thread
+    {
+        std::lock_guard<std::mutex> lock(scheduler.mutex);
+        scheduler.stop = true;
+    }
+    scheduler.wake.notify_all();
+    if (scheduler.thread.joinable())
+    {
+        scheduler.thread.join();
+    }
+}
+
+maintenanceStats getMaintenanceStats(maintenanceScheduler &scheduler)
+{
+    // Function to read the progress of the running pass and the results of the last one
+    // @param: scheduler - the scheduler running the thread
+    std::lock_guard<std::mutex> lock(scheduler.mutex);
+    return {scheduler.running, scheduler.reclaimedPages, scheduler.freePages, scheduler.passes, scheduler.errors,
+            scheduler.lastPassEnd, scheduler.lastPassSeconds, scheduler.lastCheckpointedPages, scheduler.lastReclaimedPages, scheduler.lastDroppedTerms,
+            scheduler.lastPrunedChanges};
+}
@@ -0,0 +1,361 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cctype>
+#include <algorithm>
+#include <functional>
+
+// The kinds of nodes a parsed query can contain
+enum queryNodeType {
+    QUERY_PHRASE,
+    QUERY_AND,
+    QUERY_OR,
+    QUERY_NOT,
+    QUERY_NEAR
+};
+
+// struct representing a node of the parsed query tree
+struct queryNode {
+    queryNodeType type;
+    // words of the phrase, only used by QUERY_PHRASE
+    std::vector<std::string> words;
+    // maximum number of words between both sides, only used by QUERY_NEAR
+    int distance;
+    std::vector<queryNode> children;
+};
+
+struct parsedQuery {
+    int errorCode;
+    queryNode root;
+};
+
+// Limits keeping the parse tree and the windows of NEAR small, queries above them are rejected
+const int maxNearDistance = 1000;
+const size_t maxQueryTokens = 256;
+const int maxQueryDepth = 32;
+
+// The kinds of tokens the query tokenizer produces
+enum queryTokenType {
+    TOKEN_WORD,
+    TOKEN_PHRASE,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_NOT,
+    TOKEN_NEAR,
+    TOKEN_OPEN,
+    TOKEN_CLOSE
+};
+
+struct queryToken {
+    queryTokenType type;
+    std::string text;
+    int distance;
+};
+
+queryNode makePhraseNode(std::vector<std::string> words)
+{
+    queryNode node;
+    node.type = QUERY_PHRASE;
+    node.words = words;
+    node.distance = 0;
+    return node;
+}
+
+queryNode makeOperatorNode(queryNodeType type, queryNode left, queryNode right, int distance = 0)
+{
+    queryNode node;
+    node.type = type;
+    node.distance = distance;
+    node.children.push_back(left);
+    node.children.push_back(right);
+    return node;
+}
+
+int tokenizeQuery(std::string query, std::vector<queryToken> &tokens)
+{
+    // Function to split a query into tokens
+    // @param: query - the query, e.g. `"old man" AND (sea OR fish) NOT shark`
+    // @param: tokens - vector the tokens are appended to
+    size_t i = 0;
+
+    while (i < query.size())
+    {
+        char c = query[i];
+
+        if (std::isspace((unsigned char)c))
+        {
+            i++;
+            continue;
+        }
+
+        if (tokens.size() >= maxQueryTokens)
+        {
+            return 1;
+        }
+
+        if (c == '(' || c == ')')
+        {
+            tokens.push_back({c == '(' ? TOKEN_OPEN : TOKEN_CLOSE, std::string(1, c), 0});
+            i++;
+            continue;
+        }
+
+        if (c == '"')
+        {
+            // Quoted phrase, runs until the closing quote
+            size_t end = query.find('"', i + 1);
+            if (end == std::string::npos)
+            {
+                return 1;
+            }
+            tokens.push_back({TOKEN_PHRASE, query.substr(i + 1, end - i - 1), 0});
+            i = end + 1;
+            continue;
+        }
+
+        size_t end = i;
+        while (end < query.size() && !std::isspace((unsigned char)query[end]) && query[end] != '(' && query[end] != ')' && query[end] != '"')
+        {
+            end++;
+        }
+        std::string word = query.substr(i, end - i);
+        i = end;
+
+        // Operators are only recognised in upper case, so "and" can still be searched for
+        if (word == "AND")
+        {
+            tokens.push_back({TOKEN_AND, word, 0});
+        }
+        else if (word == "OR")
+        {
+            tokens.push_back({TOKEN_OR, word, 0});
+        }
+        else if (word == "NOT")
+        {
+            tokens.push_back({TOKEN_NOT, word, 0});
+        }
+        else if (word.rfind("NEAR/", 0) == 0 && word.size() > 5 && std::all_of(word.begin() + 5, word.end(), [](unsigned char c) { return std::isdigit(c); }))
+        {
+            // Check the length first, so stoi can't overflow
+            std::string digits = word.substr(5);
+            if (digits.size() > std::to_string(maxNearDistance).size() || std::stoi(digits) > maxNearDistance)
+            {
+                return 1;
+            }
+            tokens.push_back({TOKEN_NEAR, word, std::stoi(digits)});
+        }
+        else
+        {
+            tokens.push_back({TOKEN_WORD, word, 0});
+        }
+    }
+
+    return 0;
+}
+
+// Recursive descent parser over the token list
+//   or    := and (OR and)*
+//   and   := near ([AND] near)*
+//   near  := unary (NEAR/n unary)*
+//   unary := NOT unary | '(' or ')' | "phrase" | word
+struct queryParser {
+    std::vector<queryToken> tokens;
+    size_t pos = 0;
+    int errorCode = 0;
+    // number of NOTs and parentheses around the current token
+    int depth = 0;
+
+    bool atEnd()
+    {
+        return pos >= tokens.size();
+    }
+
+    bool peek(queryTokenType type)
+    {
+        return !atEnd() && tokens[pos].type == type;
+    }
+
+    queryNode parseOr()
+    {
+        queryNode left = parseAnd();
+        while (errorCode == 0 && peek(TOKEN_OR))
+        {
+            pos++;
+            left = makeOperatorNode(QUERY_OR, left, parseAnd());
+        }
+        return left;
+    }
+
+    queryNode parseAnd()
+    {
+        queryNode left = parseNear();
+        while (errorCode == 0 && !atEnd() && !peek(TOKEN_OR) && !peek(TOKEN_CLOSE))
+        {
+            // Juxtaposed terms are implicitly combined with AND
+            if (peek(TOKEN_AND))
+            {
+                pos++;
+            }
+            left = makeOperatorNode(QUERY_AND, left, parseNear());
+        }
+        return left;
+    }
+
+    queryNode parseNear()
+    {
+        queryNode left = parseUnary();
+        while (errorCode == 0 && peek(TOKEN_NEAR))
+        {
+            int distance = tokens[pos].distance;
+            pos++;
+            left = makeOperatorNode(QUERY_NEAR, left, parseUnary(), distance);
+        }
+        return left;
+    }
+
+    queryNode parseUnary()
+    {
+        if (atEnd())
+        {
+            errorCode = 1;
+            return makePhraseNode({});
+        }
+
+        queryToken token = tokens[pos++];
+        if ((token.type == TOKEN_NOT || token.type == TOKEN_OPEN) && depth >= maxQueryDepth)
+        {
+            // Every level is a recursion, deeply nested queries would overflow the stack
+            errorCode = 1;
+            return makePhraseNode({});
+        }
+
+        switch (token.type)
+        {
+        case TOKEN_NOT:
+        {
+            queryNode node;
+            node.type = QUERY_NOT;
+            node.distance = 0;
+            depth++;
+            node.children.push_back(parseUnary());
+            depth--;
+            return node;
+        }
+        case TOKEN_OPEN:
+        {
+            depth++;
+            queryNode node = parseOr();
+            depth--;
+            if (!peek(TOKEN_CLOSE))
+            {
+                errorCode = 1;
+            }
+            pos++;
+            return node;
+        }
+        case TOKEN_PHRASE:
+        case TOKEN_WORD:
+        {
+            std::vector<std::string> words;
+            std::string word;
+            std::istringstream stream(token.text);
+            while (stream >> word)
+            {
+                words.push_back(word);
+            }
+            if (words.size() == 0)
+            {
+                errorCode = 1;
+            }
+            return makePhraseNode(words);
+        }
+        default:
+            errorCode = 1;
+            return makePhraseNode({});
+        }
+    }
+};
+
+bool isPositive(const queryNode &node)
+{
+    // Check that a node can produce hits on its own, i.e. is not a bare negation
+    // @param: node - the node to check
+    switch (node.type)
+    {
+    case QUERY_PHRASE:
+        return true;
+    case QUERY_NOT:
+        return false;
+    case QUERY_AND:
+    {
+        // "a AND NOT b" is fine as long as the other side produces hits
+        bool leftNegated = node.children[0].type == QUERY_NOT && isPositive(node.children[0].children[0]);
+        bool rightNegated = node.children[1].type == QUERY_NOT && isPositive(node.children[1].children[0]);
+        bool left = isPositive(node.children[0]);
+        bool right = isPositive(node.children[1]);
+        return (left && (right || rightNegated)) || (leftNegated && right);
+    }
+    default:
+        // OR and NEAR need hits from both sides
+        return isPositive(node.children[0]) && isPositive(node.children[1]);
+    }
+}
+
+parsedQuery parseQuery(std::string query)
+{
+    // Function to parse a boolean / proximity query into a tree
+    // @param: query - the query text
+    parsedQuery result;
+    queryParser parser;
+
+    result.errorCode = tokenizeQuery(query, parser.tokens);
+    if (result.errorCode != 0 || parser.tokens.size() == 0)
+    {
+        result.errorCode = 1;
+        return result;
+    }
+
+    result.root = parser.parseOr();
+
+    if (parser.errorCode != 0 || !parser.atEnd() || !isPositive(result.root))
+    {
+        result.errorCode = 1;
+        return result;
+    }
+
+    result.errorCode = 0;
+    return result;
+}
+
+double estimatePhraseCostByLength(const queryNode &node)
+{
+    // Estimate how expensive and how likely to match a phrase is without knowing the texts, between 0 and 1
+    // Longer words have fewer fuzzy matches, and every extra word in a phrase narrows it down further
+    // @param: node - the phrase to estimate
+    double cost = 1.0;
+    for (auto word : node.words)
+    {
+        cost *= 1.0 / (1.0 + word.size());
+    }
+    return cost;
+}
+
+double estimateQueryCost(const queryNode &node, const std::function<double(const queryNode &)> &phraseCost = estimatePhraseCostByLength)
+{
+    // Estimate how expensive and how likely to match a node is, lower is cheaper / rarer
+    // @param: node - the node to estimate
+    // @param: phraseCost - estimate of a single phrase, between 0 and 1
+    switch (node.type)
+    {
+    case QUERY_PHRASE:
+        return phraseCost(node);
+    case QUERY_NOT:
+        // Negations can only remove hits, evaluate them after the positive side
+        return 1.0 + estimateQueryCost(node.children[0], phraseCost);
+    case QUERY_AND:
+    case QUERY_NEAR:
+        return std::min(estimateQueryCost(node.children[0], phraseCost), estimateQueryCost(node.children[1], phraseCost));
+    default:
+        return estimateQueryCost(node.children[0], phraseCost) + estimateQueryCost(node.children[1], phraseCost);
+    }
+}
@@ -0,0 +1,291 @@
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <exception>
+
+// struct holding the state of a replica following the change log of a primary
+struct replicaState {
+    // e.g. http://primary:1984
+    std::string primaryUrl;
+    // how long to wait before asking the primary again once caught up or after an error
+    int pollMs;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop = false;
+
+    // generation of the primary the replica applied the changes up to
+    long long appliedGeneration = 0;
+    // id of the database of the primary the changes came from
+    std::string primaryId;
+    // id of the database of the replica, sent along so the primary knows which removals it still needs
+    std::string replicaId;
+    // latest generation the primary reported
+    long long primaryGeneration = 0;
+    // last time the primary confirmed the replica had applied every change
+    std::chrono::steady_clock::time_point caughtUpAt = std::chrono::steady_clock::now();
+    long long errors = 0;
+};
+
+// struct to make reading the state of a replica for metrics easier
+struct replicationStats {
+    long long appliedGeneration;
+    long long primaryGeneration;
+    double lagSeconds;
+    long long errors;
+};
+
+const int changeLogBatchSize = 64;
+
+bool validChange(const nlohmann::json &change)
+{
+    // Function to check that a change returned by /changes has every field applyChanges reads, with the right types
+    // @param: change - the change
+    if (!change.is_object() || change.count("generation") == 0 || change.count("rowId") == 0 || change.count("removed") == 0 ||
+        !change.at("generation").is_number_integer() || !change.at("rowId").is_number_integer() || !change.at("removed").is_boolean())
+    {
+        return false;
+    }
+    if (change.at("removed").get<bool>())
+    {
+        return true;
+    }
+
+    for (auto field : {"bookId", "bookName", "text"})
+    {
+        if (change.count(field) == 0 || !change.at(field).is_string())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int applyChanges(sqlite3 *db, const nlohmann::json &changes, long long generation)
+{
+    // Function to apply changes of the primary to the database of the replica in one transaction
+    // The generation is stored in the same transaction, so a crash never applies changes twice or skips them
+    // @param: db - the database
+    // @param: changes - the changes, as returned by /changes
+    // @param: generation - the generation of the primary after the changes
+    std::vector<std::string> arguments = {};
+    if (executePreparedStatement(db, "BEGIN;", arguments) != 0)
+    {
+        return 1;
+    }
+
+    int rc = 0;
+    for (auto &change : changes)
+    {
+        if (change["removed"].get<bool>())
+        {
+            rc = deleteBookRow(db, change["rowId"]);
+        }
+        else
+        {
+            rc = putBookRow(db, change["rowId"], change["bookId"], change["bookName"], change["text"]);
+        }
+
+        if (rc != 0)
+        {
+            break;
+        }
+    }
+
+    if (rc == 0)
+    {
+        rc = setReplicatedGeneration(db, generation);
+    }
+
+    if (rc != 0 || executePreparedStatement(db, "COMMIT;", arguments) != 0)
+    {
+        executePreparedStatement(db, "ROLLBACK;", arguments);
+        return 1;
+    }
+
+    return 0;
+}
+
+int resetReplica(sqlite3 *db, std::string primaryId)
+{
+    // Function to remove every book of the replica, so it can follow a primary from the beginning
+    // @param: db - the database
+    // @param: primaryId - the id of the database of the primary to follow
+    std::vector<std::string> arguments = {};
+    if (executePreparedStatement(db, "BEGIN;", arguments) != 0)
+    {
+        return 1;
+    }
+
+    if (removeAllBooks(db) != 0 || setReplicatedPrimary(db, primaryId) != 0 || executePreparedStatement(db, "COMMIT;", arguments) != 0)
+    {
+        executePreparedStatement(db, "ROLLBACK;", arguments);
+        return 1;
+    }
+
+    return 0;
+}
+
+int pullChanges(sqlite3 *db, searchIndex &index, replicaState &replica)
+{
+    // Function to fetch the next changes from the primary and apply them
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: replica - the state of the replica
+    // @return: the number of changes applied, -1 on errors
+    long long applied;
+    std::string knownPrimaryId;
+    {
+        std::lock_guard<std::mutex> lock(replica.mutex);
+        applied = replica.appliedGeneration;
+        knownPrimaryId = replica.primaryId;
+    }
+
+    nlohmann::json req;
+    req["since"] = applied;
+    req["limit"] = changeLogBatchSize;
+    req["replica"] = replica.replicaId;
+
+    auto response = postToInstance(replica.primaryUrl, "/changes", req.dump(), 10000);
+    if (response.errorCode != 0 || response.status != 200)
+    {
+        return -1;
+    }
+
+    auto changeLog = nlohmann::json::parse(response.body, nullptr, false);
+    if (changeLog.is_discarded() || !changeLog.is_object() || !changeLog["generation"].is_number() || !changeLog["changes"].is_array() || !changeLog["databaseId"].is_string() ||
+        !changeLog["prunedGeneration"].is_number())
+    {
+        return -1;
+    }
+
+    long long primaryGeneration = changeLog["generation"];
+    std::string primaryId = changeLog["databaseId"];
+    long long prunedGeneration = changeLog["prunedGeneration"];
+    auto &changes = changeLog["changes"];
+
+    for (auto &change : changes)
+    {
+        if (!validChange(change))
+        {
+            std::cout << "Invalid change from " << replica.primaryUrl << ": " << change.dump() << std::endl;
+            return -1;
+        }
+    }
+
+    if (primaryId != knownPrimaryId || primaryGeneration < applied || (applied > 0 && applied < prunedGeneration))
+    {
+        // The primary runs on another database, started over or pruned removals the replica didn't apply yet,
+        // so everything applied so far is outdated
+        if (writeIndexed(db, index, [&] { return resetReplica(db, primaryId); }) != 0)
+        {
+            return -1;
+        }
+
+        std::lock_guard<std::mutex> lock(replica.mutex);
+        replica.appliedGeneration = 0;
+        replica.primaryId = primaryId;
+        replica.primaryGeneration = primaryGeneration;
+        return 0;
+    }
+
+    long long generation = applied;
+    if (changes.size() > 0)
+    {
+        generation = changes.back()["generation"];
+        if (writeIndexed(db, index, [&] { return applyChanges(db, changes, generation); }) != 0)
+        {
+            return -1;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(replica.mutex);
+    replica.appliedGeneration = generation;
+    replica.primaryGeneration = std::max(primaryGeneration, generation);
+    if (replica.appliedGeneration == replica.primaryGeneration)
+    {
+        replica.caughtUpAt = std::chrono::steady_clock::now();
+    }
+
+    return changes.size();
+}
+
+void startReplication(sqlite3 *db, searchIndex &index, replicaState &replica)
+{
+    // Function to start following the primary, resuming at the generation stored in the database
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: replica - the state of the replica
+    replica.appliedGeneration = std::max(0LL, getReplicatedGeneration(db));
+    replica.primaryId = getReplicatedPrimary(db);
+    replica.replicaId = getDatabaseId(db);
+
+    replica.thread = std::thread([db, &index, &replica]() {
+        while (true)
+        {
+            // An exception escaping the thread would end the server, treat it like any other failed pull and try again
+            int applied;
+            try
+            {
+                applied = pullChanges(db, index, replica);
+            }
+            catch (const std::exception &e)
+            {
+                std::cout << "Failed to pull changes from " << replica.primaryUrl << ": " << e.what() << std::endl;
+                applied = -1;
+            }
+
+            std::unique_lock<std::mutex> lock(replica.mutex);
+            if (applied < 0)
+            {
+                replica.errors++;
+            }
+
+            // Keep going while the primary has more changes, wait once caught up
+            if (applied == changeLogBatchSize)
+            {
+                if (replica.stop)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (replica.wake.wait_for(lock, std::chrono::milliseconds(replica.pollMs), [&replica] { return replica.stop; }))
+            {
+                break;
+            }
+        }
+    });
+}
+
+void stopReplication(replicaState &replica)
+{
+    // Function to stop following the primary
+    // @param: replica - the state of the replica
+    {
+        std::lock_guard<std::mutex> lock(replica.mutex);
+        replica.stop = true;
+    }
+    replica.wake.notify_all();
+    if (replica.thread.joinable())
+    {
+        replica.thread.join();
+    }
+}
+
+replicationStats getReplicationStats(replicaState &replica)
+{
+    // Function to read how far the replica is behind the primary
+    // @param: replica - the state of the replica
+    // The lag is the age of the newest state known to be complete, so it also grows while the primary can't be reached
+    std::lock_guard<std::mutex> lock(replica.mutex);
+    double lagSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replica.caughtUpAt).count();
+
+    return {replica.appliedGeneration, replica.primaryGeneration, lagSeconds, replica.errors};
+}
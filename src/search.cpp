@@ -0,0 +1,835 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include <shared_mutex>
+#include "query.cpp"
+
+// struct describing a book with results, stored once per book instead of once per result
+struct bookRef {
+    std::string bookId;
+    std::string bookName;
+};
+
+// struct to make passing around the results between functions easier
+struct searchResult {
+    // index of the book in searchResults.books
+    int book;
+    int pos;
+    // number of matched words
+    int length;
+    // byte offsets of the matched words in the text, end is exclusive
+    size_t start;
+    size_t end;
+    // span of the periText in searchResults.periTexts
+    size_t periTextOffset;
+    size_t periTextLength;
+};
+
+// struct describing where a paginated search stopped, so the next page can resume from there
+struct searchCursor {
+    // ID of the book in the fulltext table
+    long long rowId;
+    // position and length of the last returned hit in that book
+    int pos;
+    int length;
+    // hash of the query the cursor belongs to
+    unsigned long long queryHash;
+};
+
+struct searchResults {
+    int errorCode;
+    std::vector<bookRef> books;
+    std::vector<searchResult> results;
+    // the periTexts of all results back to back, so they are allocated and freed together
+    std::string periTexts;
+    // only set by paginated searches, if there could be more results after this page
+    bool hasNext = false;
+    searchCursor next;
+    // set if the search ran out of time and only contains the results found until then
+    bool truncated = false;
+};
+
+// struct describing where in the text a query matched
+struct queryHit {
+    int pos;
+    int length;
+};
+
+// inclusive range of word positions a phrase is allowed to start at
+typedef std::pair<int, int> hitWindow;
+
+// struct remembering which terms of the vocabulary match the words of a search
+// Every term is only compared once per request, however often it appears in the books
+struct termMatches {
+    searchIndex &index;
+    // by normalised search word, for every term id: -1 not compared yet, 0 no match, 1 match
+    std::map<std::u32string, std::vector<signed char>> bySearchWord;
+};
+
+std::vector<signed char> &getTermMatches(termMatches &matches, const std::u32string &normalisedSearch)
+{
+    // Function to get the remembered matches of a search word, sized to the vocabulary
+    // @param: matches - the matches of the request
+    // @param: normalisedSearch - the normalised word of the search
+    auto &known = matches.bySearchWord[normalisedSearch];
+    if (known.size() < matches.index.terms.size())
+    {
+        known.resize(matches.index.terms.size(), -1);
+    }
+    return known;
+}
+
+bool matchTerm(termMatches &matches, std::vector<signed char> &known, const std::u32string &normalisedSearch, uint32_t term, searchDeadline *deadline = nullptr)
+{
+    // Function to check if a term matches a search word, comparing them only the first time
+    // @param: matches - the matches of the request
+    // @param: known - the remembered matches of the search word
+    // @param: normalisedSearch - the normalised word of the search
+    // @param: term - the id of the term
+    if (known[term] < 0)
+    {
+        bool match = checkWord(matches.index.terms[term], normalisedSearch, deadline);
+
+        // A comparison cut short by the deadline isn't an answer
+        if (deadline != nullptr && deadline->expired)
+        {
+            return false;
+        }
+        known[term] = match;
+    }
+
+    return known[term] == 1;
+}
+
+double estimateWordCost(searchIndex &index, const std::u32string &normalisedSearch)
+{
+    // Function to estimate how common a search word is from the statistics of its term, between 0 and 1
+    // The share of books containing it decides how often evaluation stops early, the share of words how many positions are checked
+    // Fuzzy matches aren't counted, so shorter words, which have more of them, still count as more common
+    // @param: index - the index, its mutex has to be held
+    // @param: normalisedSearch - the normalised word of the search
+    termStats stats;
+    auto found = index.termIds.find(normalisedSearch);
+    if (found != index.termIds.end())
+    {
+        stats = index.stats[found->second];
+    }
+
+    double documents = (stats.documents + 1.0) / (index.books.size() + 1.0);
+    double occurrences = (stats.occurrences + 1.0) / (index.tokenCount + 1.0);
+    return documents * occurrences / (1.0 + normalisedSearch.size());
+}
+
+double estimatePhraseCostByStats(searchIndex &index, const queryNode &node)
+{
+    // Function to estimate a phrase by its rarest word, a phrase can't be more common than any of its words
+    // @param: index - the index, its mutex has to be held
+    // @param: node - the phrase to estimate
+    double cost = 1.0;
+    for (auto &word : node.words)
+    {
+        cost = std::min(cost, estimateWordCost(index, normaliseWord(word)));
+    }
+    return cost;
+}
+
+std::vector<queryHit> findPhraseAtAnchor(const indexedBook &book, const std::vector<std::u32string> &normalisedSearchText, const std::vector<std::vector<signed char> *> &known, termMatches &matches, size_t anchor, const std::vector<size_t> &anchorTerms, const std::vector<hitWindow> &windows, size_t maxHits, searchDeadline *deadline)
+{
+    // Function to find a phrase from the positions of one of its words, only comparing the other words next to them
+    // @param: book - the indexed book
+    // @param: normalisedSearchText - the normalised words of the phrase
+    // @param: known - the remembered matches of every word
+    // @param: matches - the matches of the request
+    // @param: anchor - the word whose positions are used
+    // @param: anchorTerms - the terms of the book matching the anchor, as positions in book.postingTerms
+    // @param: windows - sorted, non overlapping ranges of start positions
+    // @param: maxHits - stop after this many hits
+    // @param: deadline - optional deadline, the search stops with the hits found so far once it expires
+    std::vector<queryHit> hits;
+
+    std::vector<uint32_t> positions;
+    for (auto t : anchorTerms)
+    {
+        auto termPositions = getPostings(hotPostings, book, t);
+        positions.insert(positions.end(), termPositions->begin(), termPositions->end());
+    }
+    // The positions of every term are sorted already, only several terms have to be merged
+    if (anchorTerms.size() > 1)
+    {
+        std::sort(positions.begin(), positions.end());
+    }
+
+    int lastStart = (int)book.tokens.size() - (int)normalisedSearchText.size();
+    size_t window = 0;
+    for (auto pos : positions)
+    {
+        int start = (int)pos - (int)anchor;
+        while (window < windows.size() && std::min(lastStart, windows[window].second) < start)
+        {
+            window++;
+        }
+        if (window == windows.size())
+        {
+            break;
+        }
+        if (start < std::max(0, windows[window].first))
+        {
+            continue;
+        }
+
+        if (deadline != nullptr && deadline->check())
+        {
+            return hits;
+        }
+
+        bool match = true;
+        for (size_t j = 0; j < normalisedSearchText.size() && match; j++)
+        {
+            match = j == anchor || matchTerm(matches, *known[j], normalisedSearchText[j], book.tokens[start + j], deadline);
+        }
+
+        if (match && !(deadline != nullptr && deadline->expired))
+        {
+            hits.push_back({start, (int)normalisedSearchText.size()});
+            if (hits.size() >= maxHits)
+            {
+                return hits;
+            }
+        }
+    }
+
+    return hits;
+}
+
+std::vector<queryHit> findPhrase(const indexedBook &book, const std::vector<std::string> &splitSearchText, termMatches &matches, const std::vector<hitWindow> *windows = nullptr, size_t maxHits = SIZE_MAX, searchDeadline *deadline = nullptr)
+{
+    // Function to find every position the words of a phrase appear at consecutively
+    // @param: book - the indexed book
+    // @param: splitSearchText - the words of the phrase
+    // @param: matches - the matches of the request
+    // @param: windows - optional sorted, non overlapping ranges of start positions to restrict the scan to
+    // @param: maxHits - stop scanning after this many hits
+    // @param: deadline - optional deadline, the scan stops with the hits found so far once it expires
+    std::vector<queryHit> hits;
+
+    int lastStart = (int)book.tokens.size() - (int)splitSearchText.size();
+    if (splitSearchText.size() == 0 || lastStart < 0)
+    {
+        return hits;
+    }
+
+    std::vector<std::u32string> normalisedSearchText;
+    std::vector<std::vector<signed char> *> known;
+    for (auto &word : splitSearchText)
+    {
+        normalisedSearchText.push_back(normaliseWord(word));
+        known.push_back(&getTermMatches(matches, normalisedSearchText.back()));
+    }
+
+    std::vector<hitWindow> allText = {{0, lastStart}};
+    if (windows == nullptr)
+    {
+        windows = &allText;
+    }
+
+    size_t scanLength = 0;
+    for (auto window : *windows)
+    {
+        scanLength += std::max(0, std::min(lastStart, window.second) - std::max(0, window.first) + 1);
+    }
+
+    // Comparing the terms of the book only pays off if the scan would check more positions
+    if (scanLength > book.postingTerms.size())
+    {
+        // Start at the word the statistics say is rarest, the whole phrase can only match where it does
+        size_t anchor = 0;
+        double anchorCost = 2.0;
+        for (size_t j = 0; j < normalisedSearchText.size(); j++)
+        {
+            double cost = estimateWordCost(matches.index, normalisedSearchText[j]);
+            if (cost < anchorCost)
+            {
+                anchor = j;
+                anchorCost = cost;
+            }
+        }
+
+        std::vector<size_t> anchorTerms;
+        size_t anchorCount = 0;
+        for (size_t t = 0; t < book.postingTerms.size(); t++)
+        {
+            if (matchTerm(matches, *known[anchor], normalisedSearchText[anchor], book.postingTerms[t], deadline))
+            {
+                anchorTerms.push_back(t);
+                anchorCount += book.postingCounts[t];
+            }
+            if (deadline != nullptr && deadline->expired)
+            {
+                return hits;
+            }
+        }
+
+        // Jumping between the positions of a common word is slower than scanning
+        if (anchorCount * 8 < scanLength)
+        {
+            return findPhraseAtAnchor(book, normalisedSearchText, known, matches, anchor, anchorTerms, *windows, maxHits, deadline);
+        }
+    }
+
+    for (auto window : *windows)
+    {
+        for (int i = std::max(0, window.first); i <= std::min(lastStart, window.second); i++)
+        {
+            if (deadline != nullptr && deadline->check())
+            {
+                return hits;
+            }
+
+            // Every word of the search has to match
+            bool match = true;
+            for (size_t j = 0; j < normalisedSearchText.size() && match; j++)
+            {
+                match = matchTerm(matches, *known[j], normalisedSearchText[j], book.tokens[i + j], deadline);
+            }
+
+            if (match && !(deadline != nullptr && deadline->expired))
+            {
+                hits.push_back({i, (int)splitSearchText.size()});
+                if (hits.size() >= maxHits)
+                {
+                    return hits;
+                }
+            }
+        }
+    }
+
+    return hits;
+}
+
+std::vector<queryHit> mergeHits(std::vector<queryHit> left, const std::vector<queryHit> &right)
+{
+    // Function to merge two lists of hits into one sorted list without duplicates
+    left.insert(left.end(), right.begin(), right.end());
+
+    std::sort(left.begin(), left.end(), [](const queryHit &a, const queryHit &b) {
+        return a.pos < b.pos || (a.pos == b.pos && a.length < b.length);
+    });
+    left.erase(std::unique(left.begin(), left.end(), [](const queryHit &a, const queryHit &b) {
+        return a.pos == b.pos && a.length == b.length;
+    }), left.end());
+
+    return left;
+}
+
+std::vector<queryHit> evaluateQuery(const queryNode &node, const indexedBook &book, termMatches &matches, searchDeadline *deadline = nullptr)
+{
+    // Function to find all hits of a parsed query in a text
+    // Children of AND and NEAR are evaluated cheapest / rarest first so the others can be skipped or narrowed down
+    // @param: node - the parsed query
+    // @param: book - the indexed book
+    // @param: matches - the matches of the request
+    // @param: deadline - optional deadline, once expired the hits are incomplete
+    auto phraseCost = [&matches](const queryNode &phrase) { return estimatePhraseCostByStats(matches.index, phrase); };
+
+    switch (node.type)
+    {
+    case QUERY_PHRASE:
+        return findPhrase(book, node.words, matches, nullptr, SIZE_MAX, deadline);
+    case QUERY_OR:
+        return mergeHits(evaluateQuery(node.children[0], book, matches, deadline), evaluateQuery(node.children[1], book, matches, deadline));
+    case QUERY_AND:
+    {
+        const queryNode *first = &node.children[0];
+        const queryNode *second = &node.children[1];
+        if (first->type == QUERY_NOT)
+        {
+            // A negated side has no hits of its own, it can only filter the hits of the other side whatever the costs are
+            std::swap(first, second);
+        }
+        else if (second->type != QUERY_NOT && estimateQueryCost(*second, phraseCost) < estimateQueryCost(*first, phraseCost))
+        {
+            std::swap(first, second);
+        }
+
+        auto firstHits = evaluateQuery(*first, book, matches, deadline);
+        if (firstHits.size() == 0)
+        {
+            return firstHits;
+        }
+
+        // A negated side only decides whether the hits of the other side are kept
+        if (second->type == QUERY_NOT)
+        {
+            if (evaluateQuery(second->children[0], book, matches, deadline).size() > 0)
+            {
+                return {};
+            }
+            return firstHits;
+        }
+
+        auto secondHits = evaluateQuery(*second, book, matches, deadline);
+        if (secondHits.size() == 0)
+        {
+            return secondHits;
+        }
+        return mergeHits(firstHits, secondHits);
+    }
+    case QUERY_NEAR:
+    {
+        const queryNode *first = &node.children[0];
+        const queryNode *second = &node.children[1];
+        if (estimateQueryCost(*second, phraseCost) < estimateQueryCost(*first, phraseCost))
+        {
+            std::swap(first, second);
+        }
+
+        auto firstHits = evaluateQuery(*first, book, matches, deadline);
+        if (firstHits.size() == 0)
+        {
+            return firstHits;
+        }
+
+        std::vector<queryHit> secondHits;
+        if (second->type == QUERY_PHRASE)
+        {
+            // Only scan the positions close enough to a hit of the first side
+            int length = second->words.size();
+            std::vector<hitWindow> windows;
+            for (auto hit : firstHits)
+            {
+                hitWindow window = {hit.pos - node.distance - length, hit.pos + hit.length + node.distance};
+                if (windows.size() > 0 && window.first <= windows.back().second + 1)
+                {
+                    windows.back().second = std::max(windows.back().second, window.second);
+                }
+                else
+                {
+                    windows.push_back(window);
+                }
+            }
+            secondHits = findPhrase(book, second->words, matches, &windows, SIZE_MAX, deadline);
+        }
+        else
+        {
+            secondHits = evaluateQuery(*second, book, matches, deadline);
+        }
+
+        // Keep every pair with at most `distance` words between them, spanning both
+        std::vector<queryHit> hits;
+        for (auto a : firstHits)
+        {
+            for (auto b : secondHits)
+            {
+                int gap = std::max(a.pos, b.pos) - std::min(a.pos + a.length, b.pos + b.length);
+                if (gap <= node.distance)
+                {
+                    int pos = std::min(a.pos, b.pos);
+                    hits.push_back({pos, std::max(a.pos + a.length, b.pos + b.length) - pos});
+                }
+            }
+        }
+        return mergeHits(hits, {});
+    }
+    default:
+        // Bare negations have no hits of their own, they are handled by AND
+        return {};
+    }
+}
+
+void appendPeriText(std::string &periTexts, const std::string &text, const std::vector<uint32_t> &offsets, int pos, int periTextLength)
+{
+    // Function to copy the text surrounding a hit out of the book
+    // @param: periTexts - the buffer the periText is appended to
+    // @param: text - the text of the book
+    // @param: offsets - the offsets of the words, from the index
+    // @param: pos - the position of the hit
+    // @param: periTextLength - the number of words to include
+    int splitTextLength = offsets.size() - 1;
+    int first = std::max(0, pos - (periTextLength / 2));
+    int last = std::min(splitTextLength, pos - (periTextLength / 2) + periTextLength);
+
+    if (first >= last)
+    {
+        return;
+    }
+
+    // The words are separated by single spaces, so the snippet is one slice of the text
+    periTexts.append(text, offsets[first], offsets[last] - 1 - offsets[first]);
+    periTexts += ' ';
+}
+
+std::string getPeriText(const searchResults &sRes, const searchResult &result)
+{
+    // Function to get the periText of a result out of the buffer of its results
+    return sRes.periTexts.substr(result.periTextOffset, result.periTextLength);
+}
+
+int searchBookText(sqlite3 *db, searchResults &sRes, long long rowId, const indexedBook &book, const queryNode &query, termMatches &matches, size_t hitLimit, queryHit after, int minPeriTextLength = 15, bool withPeriText = true, searchDeadline *deadline = nullptr)
+{
+    // Function to search for a parsed query in an indexed book and append the results
+    // The text is only read from the database for the periTexts of the hits which are returned
+    // @param: db - the database
+    // @param: sRes - the results to append to, the book is only added to its books if it has results
+    // @param: rowId - the ID of the row of the book
+    // @param: book - the indexed book
+    // @param: query - the parsed query to search for
+    // @param: matches - the matches of the request
+    // @param: hitLimit - the maximum number of hits to return
+    // @param: after - only return hits after this one, pos -1 to start at the beginning
+    // @param: withPeriText - argument specifying if the surrounding text should be returned or only the offsets of the hits
+    // @param: deadline - optional deadline, once expired the results are flagged as truncated
+    // @return: the number of results appended, -1 if the text couldn't be read
+    std::vector<queryHit> hits;
+
+    if (query.type == QUERY_PHRASE)
+    {
+        // Phrases are found in order, so the scan can start at the cursor and stop once there are enough hits
+        std::vector<hitWindow> windows = {{after.pos + 1, (int)book.tokens.size()}};
+        hits = findPhrase(book, query.words, matches, &windows, hitLimit, deadline);
+    }
+    else
+    {
+        for (auto hit : evaluateQuery(query, book, matches, deadline))
+        {
+            if (hit.pos > after.pos || (hit.pos == after.pos && hit.length > after.length))
+            {
+                hits.push_back(hit);
+            }
+        }
+    }
+
+    if (deadline != nullptr && deadline->expired)
+    {
+        sRes.truncated = true;
+
+        // Hits of a phrase found before the deadline are still valid, an interrupted NOT or AND could be wrong
+        if (query.type != QUERY_PHRASE)
+        {
+            hits.clear();
+        }
+    }
+
+    // Keep the hits which will be returned
+    if (hits.size() > hitLimit)
+    {
+        hits.resize(hitLimit);
+    }
+    if (hits.size() == 0)
+    {
+        return 0;
+    }
+
+    std::string text;
+    if (withPeriText)
+    {
+        auto res = getBookByRowId(db, rowId);
+        if (res.errorCode == 1)
+        {
+            return -1;
+        }
+
+        // The offsets only fit the text the book was indexed from
+        if (res.results.size() > 0 && res.results[0].row[3].size() + 1 == book.offsets.back())
+        {
+            text = std::move(res.results[0].row[3]);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    int bookRefIndex = sRes.books.size();
+    sRes.books.push_back({book.bookId, book.bookName});
+    sRes.results.reserve(sRes.results.size() + hits.size());
+
+    for (auto hit : hits)
+    {
+        searchResult sR{bookRefIndex, hit.pos, hit.length, book.offsets[hit.pos], book.offsets[hit.pos + hit.length] - 1, sRes.periTexts.size(), 0};
+
+        if (withPeriText)
+        {
+            int periTextLength = std::max(minPeriTextLength, hit.length);
+            appendPeriText(sRes.periTexts, text, book.offsets, hit.pos, periTextLength);
+            sR.periTextLength = sRes.periTexts.size() - sR.periTextOffset;
+        }
+
+        sRes.results.push_back(sR);
+    }
+
+    return hits.size();
+};
+
+size_t resultLimit(int stopAfterOne, int maxResults)
+{
+    // The unpaginated routes return up to one result more than maxResults
+    return stopAfterOne ? 1 : (size_t)std::max(0, maxResults) + 1;
+}
+
+int searchPastDeadline(sqlite3 *db, searchResults &sRes, long long rowId, const indexedBook &book, const queryNode &query, termMatches &matches, queryHit after, int minPeriTextLength, bool withPeriText)
+{
+    // Function to find the next hit of a page whose deadline expired before it found anything
+    // Without it the page would end where it started, and a client following the cursors would never get further
+    // @param: db - the database
+    // @param: sRes - the truncated results, still flagged as truncated if a hit is found
+    // @param: rowId - the ID of the row of the book
+    // @param: book - the indexed book
+    // @param: query - the parsed query to search for
+    // @param: matches - the matches of the request
+    // @param: after - only return hits after this one
+    // @param: withPeriText - argument specifying if the surrounding text should be returned or only the offsets of the hits
+    // @return: the number of results appended, -1 if the text couldn't be read
+    int found = searchBookText(db, sRes, rowId, book, query, matches, 1, after, minPeriTextLength, withPeriText);
+
+    // Without another hit the book is done, so the page isn't cut short anymore
+    sRes.truncated = found > 0;
+    return found;
+}
+
+searchResults searchBookQuery(sqlite3 *db, searchIndex &index, std::string bookId, const queryNode &query, int stopAfterOne, int minPeriTextLength = 15, int maxResults = 100000, bool withPeriText = true, searchDeadline *deadline = nullptr)
+{
+    // Function to search for a parsed query in a single book
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: bookId - the id of the book
+    // @param: query - the parsed query to search for
+    // @param: stopAfterOne - argument specifying if function should continue to search after it found first result
+    // @param: withPeriText - argument specifying if the surrounding text should be returned or only the offsets of the hits
+    // @param: deadline - optional deadline, once expired the results are flagged as truncated
+    std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    searchResults sRes;
+    sRes.errorCode = 0;
+
+    long long rowId;
+    const indexedBook *book = findIndexedBook(index, bookId, rowId);
+    if (book == nullptr) {
+        return sRes;
+    }
+
+    termMatches matches{index, {}};
+    if (searchBookText(db, sRes, rowId, *book, query, matches, resultLimit(stopAfterOne, maxResults), {-1, 0}, minPeriTextLength, withPeriText, deadline) < 0)
+    {
+        sRes.errorCode = 1;
+    }
+
+    return sRes;
+};
+
+searchResults searchBookPage(sqlite3 *db, searchIndex &index, std::string bookId, const queryNode &query, searchCursor cursor, int pageSize, int minPeriTextLength = 15, bool withPeriText = true, searchDeadline *deadline = nullptr)
+{
+    // Function to get one page of the results of a parsed query in a single book
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: bookId - the id of the book
+    // @param: query - the parsed query to search for
+    // @param: cursor - where the previous page stopped, pos -1 and length 0 for the first page, its rowId isn't used
+    // @param: pageSize - the number of results per page
+    // @param: withPeriText - argument specifying if the surrounding text should be returned or only the offsets of the hits
+    // @param: deadline - optional deadline, once expired the results are flagged as truncated
+    std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    searchResults sRes;
+    sRes.errorCode = 0;
+
+    long long rowId;
+    const indexedBook *book = findIndexedBook(index, bookId, rowId);
+    if (book == nullptr) {
+        return sRes;
+    }
+
+    termMatches matches{index, {}};
+    queryHit after = {cursor.pos, cursor.length};
+    int found = searchBookText(db, sRes, rowId, *book, query, matches, std::max(1, pageSize), after, minPeriTextLength, withPeriText, deadline);
+    if (found == 0 && sRes.truncated)
+    {
+        found = searchPastDeadline(db, sRes, rowId, *book, query, matches, after, minPeriTextLength, withPeriText);
+    }
+    if (found < 0)
+    {
+        sRes.errorCode = 1;
+        return sRes;
+    }
+
+    if (sRes.results.size() == (size_t)std::max(1, pageSize) || sRes.truncated)
+    {
+        // A truncated page always has a result, the next one continues after it
+        queryHit last = {sRes.results.back().pos, sRes.results.back().length};
+        sRes.hasNext = true;
+        // The row only makes the cursor look like the ones of /search/all, resuming only uses the hit
+        sRes.next = {rowId, last.pos, last.length, cursor.queryHash};
+    }
+
+    return sRes;
+};
+
+searchResults searchBook(sqlite3 *db, searchIndex &index, std::string bookId, std::string searchText, int stopAfterOne, int minPeriTextLength = 15, int maxResults = 100000)
+{
+    // Function to search for text in a single book
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: bookId - the id of the book
+    // @param: searchText - the text to search for
+    // @param: stopAfterOne - argument specifying if function should continue to search after it found first result
+    return searchBookQuery(db, index, bookId, makePhraseNode(split(searchText, " ")), stopAfterOne, minPeriTextLength, maxResults);
+};
+
+searchResults searchAllBooksQuery(sqlite3 *db, searchIndex &index, const queryNode &query, bool stopAfterOne, int minPeriTextLength = 15, int maxResults = 100000, bool withPeriText = true, searchDeadline *deadline = nullptr)
+{
+    // Function to search for a parsed query in all books
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: query - the parsed query to search for
+    // @param: stopAfterOne - argument specifying if function should continue to search after it found first result
+    // @param: withPeriText - argument specifying if the surrounding text should be returned or only the offsets of the hits
+    // @param: deadline - optional deadline, once expired the results are flagged as truncated
+    std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    searchResults searchResults;
+    searchResults.errorCode = 0;
+
+    termMatches matches{index, {}};
+    for (auto &entry : index.books)
+    {
+        if (deadline != nullptr && deadline->check())
+        {
+            searchResults.truncated = true;
+            break;
+        }
+
+        // Every book appends its results directly, instead of copying them over from its own results
+        if (searchBookText(db, searchResults, entry.first, entry.second, query, matches, resultLimit(stopAfterOne, maxResults), {-1, 0}, minPeriTextLength, withPeriText, deadline) < 0)
+        {
+            searchResults.errorCode = 1;
+            return searchResults;
+        }
+        if (searchResults.truncated)
+        {
+            break;
+        }
+    }
+
+    return searchResults;
+};
+
+searchResults searchAllBooksPage(sqlite3 *db, searchIndex &index, const queryNode &query, searchCursor cursor, int pageSize, int minPeriTextLength = 15, bool withPeriText = true, searchDeadline *deadline = nullptr)
+{
+    // Function to get one page of the results of a parsed query in all books
+    // Books are searched in the order of their rows starting at the cursor, so earlier books are never searched again
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: query - the parsed query to search for
+    // @param: cursor - where the previous page stopped, rowId 0 for the first page
+    // @param: pageSize - the number of results per page
+    // @param: withPeriText - argument specifying if the surrounding text should be returned or only the offsets of the hits
+    // @param: deadline - optional deadline, once expired the results are flagged as truncated
+    std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    searchResults searchResults;
+    searchResults.errorCode = 0;
+    size_t pageLimit = std::max(1, pageSize);
+
+    termMatches matches{index, {}};
+    auto first = index.books.lower_bound(cursor.rowId);
+    for (auto entry = first; entry != index.books.end(); entry++)
+    {
+        long long rowId = entry->first;
+
+        // Only the book the cursor points into is resumed in the middle
+        queryHit after = rowId == cursor.rowId ? queryHit{cursor.pos, cursor.length} : queryHit{-1, 0};
+
+        // The first book is always searched, so the page gets past the cursor even if the time is already up
+        if (entry != first && deadline != nullptr && deadline->check())
+        {
+            // Let the next page start with this book
+            searchResults.truncated = true;
+            searchResults.hasNext = true;
+            searchResults.next = {rowId, after.pos, after.length, cursor.queryHash};
+            break;
+        }
+
+        int found = searchBookText(db, searchResults, rowId, entry->second, query, matches, pageLimit - searchResults.results.size(), after, minPeriTextLength, withPeriText, deadline);
+        if (found == 0 && searchResults.truncated && entry == first)
+        {
+            found = searchPastDeadline(db, searchResults, rowId, entry->second, query, matches, after, minPeriTextLength, withPeriText);
+        }
+        if (found < 0)
+        {
+            searchResults.errorCode = 1;
+            return searchResults;
+        }
+
+        if (searchResults.truncated)
+        {
+            // Continue in this book, after its last result if it returned any
+            // Only a book after the first one can be cut short without results, the page then already got past the cursor
+            queryHit last = found > 0 ? queryHit{searchResults.results.back().pos, searchResults.results.back().length} : after;
+            searchResults.hasNext = true;
+            searchResults.next = {rowId, last.pos, last.length, cursor.queryHash};
+            break;
+        }
+
+        if (searchResults.results.size() >= pageLimit)
+        {
+            searchResults.hasNext = true;
+            searchResults.next = {rowId, searchResults.results.back().pos, searchResults.results.back().length, cursor.queryHash};
+            break;
+        }
+    }
+
+    return searchResults;
+};
+
+searchResults searchAllBooks(sqlite3 *db, searchIndex &index, std::string searchText, bool stopAfterOne, int minPeriTextLength = 15, int maxResults = 100000)
+{
+    // Function to search for text in all book
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: searchText - the text to search for
+    // @param: stopAfterOne - argument specifying if function should continue to search after it found first result
+    return searchAllBooksQuery(db, index, makePhraseNode(split(searchText, " ")), stopAfterOne, minPeriTextLength, maxResults);
+};
+
+unsigned long long hashQuery(std::string query)
+{
+    // Function to hash a query with FNV-1a, so cursors stay valid across restarts
+    // @param: query - the query text
+    return fnv1a(query.data(), query.size());
+}
+
+std::string encodeCursor(searchCursor cursor)
+{
+    // Function to turn a cursor into an opaque string
+    // @param: cursor - the cursor to encode
+    std::stringstream stream;
+    // pos is stored one higher, so the start of a book (-1) stays positive
+    stream << std::hex << cursor.rowId << "-" << cursor.pos + 1 << "-" << cursor.length << "-" << cursor.queryHash;
+    return stream.str();
+}
+
+int decodeCursor(std::string encoded, unsigned long long queryHash, searchCursor &cursor)
+{
+    // Function to read a cursor returned by encodeCursor
+    // @param: encoded - the encoded cursor
+    // @param: queryHash - the hash of the current query, which has to match the one of the cursor
+    // @param: cursor - the cursor to fill
+    std::stringstream stream(encoded);
+    char dash1, dash2, dash3;
+
+    stream >> std::hex >> cursor.rowId >> dash1 >> cursor.pos >> dash2 >> cursor.length >> dash3 >> cursor.queryHash;
+
+    if (stream.fail() || !stream.eof() || dash1 != '-' || dash2 != '-' || dash3 != '-')
+    {
+        return 1;
+    }
+    cursor.pos--;
+    // pos -1 with length 0 points to the start of a book
+    if (cursor.queryHash != queryHash || cursor.rowId < 1 || cursor.pos < -1 || cursor.length < 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
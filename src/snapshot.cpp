@@ -0,0 +1,408 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Snapshots of the index are stored in native byte order as:
+//   magic, version, databaseId as its length and bytes, generation,
+//   term count, then every term as its length and code points,
+//   book count, then every book as row ID, generation, bookId, bookName, token count, tokens and offsets,
+//     followed by its postings as term count, terms, counts, starts, byte count and bytes,
+//   FNV-1a checksum of everything before it
+const char snapshotMagic[8] = {'F', 'T', 'S', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t snapshotVersion = 3;
+
+template <typename T>
+void writeValue(std::string &buffer, T value)
+{
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void writeBytes(std::string &buffer, const void *data, size_t size)
+{
+    buffer.append(reinterpret_cast<const char *>(data), size);
+}
+
+// struct reading a snapshot, every read fails instead of reading past the end
+struct snapshotReader {
+    const char *data;
+    size_t size;
+    size_t pos = 0;
+    bool failed = false;
+
+    bool readBytes(void *destination, size_t length)
+    {
+        if (failed || length > size - pos)
+        {
+            failed = true;
+            return false;
+        }
+        std::memcpy(destination, data + pos, length);
+        pos += length;
+        return true;
+    }
+
+    template <typename T>
+    T readValue()
+    {
+        T value = T();
+        readBytes(&value, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    bool readVector(std::vector<T> &values, uint64_t count)
+    {
+        // Check the length first, so a corrupt count can't allocate too much memory
+        if (failed || count > (size - pos) / sizeof(T))
+        {
+            failed = true;
+            return false;
+        }
+        values.resize(count);
+        return readBytes(values.data(), count * sizeof(T));
+    }
+
+    std::string readString()
+    {
+        uint32_t length = readValue<uint32_t>();
+        if (failed || length > size - pos)
+        {
+            failed = true;
+            return "";
+        }
+        std::string value(data + pos, length);
+        pos += length;
+        return value;
+    }
+};
+
+std::string serialiseIndex(searchIndex &index)
+{
+    // Function to turn the index into the snapshot format
+    // @param: index - the index
+    std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+
+    std::string buffer;
+    writeBytes(buffer, snapshotMagic, sizeof(snapshotMagic));
+    writeValue<uint32_t>(buffer, snapshotVersion);
+    writeValue<uint32_t>(buffer, index.databaseId.size());
+    writeBytes(buffer, index.databaseId.data(), index.databaseId.size());
+    writeValue<int64_t>(buffer, index.generation);
+
+    writeValue<uint64_t>(buffer, index.terms.size());
+    for (auto &term : index.terms)
+    {
+        writeValue<uint32_t>(buffer, term.size());
+        writeBytes(buffer, term.data(), term.size() * sizeof(char32_t));
+    }
+
+    writeValue<uint64_t>(buffer, index.books.size());
+    for (auto &entry : index.books)
+    {
+        auto &book = entry.second;
+        writeValue<int64_t>(buffer, entry.first);
+        writeValue<int64_t>(buffer, book.generation);
+        writeValue<uint32_t>(buffer, book.bookId.size());
+        writeBytes(buffer, book.bookId.data(), book.bookId.size());
+        writeValue<uint32_t>(buffer, book.bookName.size());
+        writeBytes(buffer, book.bookName.data(), book.bookName.size());
+        writeValue<uint64_t>(buffer, book.tokens.size());
+        writeBytes(buffer, book.tokens.data(), book.tokens.size() * sizeof(uint32_t));
+        writeBytes(buffer, book.offsets.data(), book.offsets.size() * sizeof(uint32_t));
+        writeValue<uint64_t>(buffer, book.postingTerms.size());
+        writeBytes(buffer, book.postingTerms.data(), book.postingTerms.size() * sizeof(uint32_t));
+        writeBytes(buffer, book.postingCounts.data(), book.postingCounts.size() * sizeof(uint32_t));
+        writeBytes(buffer, book.postingStarts.data(), book.postingStarts.size() * sizeof(uint32_t));
+        writeValue<uint64_t>(buffer, book.postingData.size());
+        writeBytes(buffer, book.postingData.data(), book.postingData.size());
+    }
+
+    writeValue<uint64_t>(buffer, fnv1a(buffer.data(), buffer.size()));
+    return buffer;
+}
+
+int writeSnapshot(searchIndex &index, std::string path)
+{
+    // Function to write a snapshot of the index
+    // It is written next to the old one first and then renamed, so a crash never leaves half a snapshot behind
+    // @param: index - the index
+    // @param: path - the file to write to
+    std::string buffer = serialiseIndex(index);
+    std::string temporaryPath = path + ".tmp";
+
+    FILE *file = std::fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return 1;
+    }
+
+    bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    written = std::fflush(file) == 0 && written;
+    written = fsync(fileno(file)) == 0 && written;
+    std::fclose(file);
+
+    if (!written || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporaryPath.c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+bool validPostings(const indexedBook &book, size_t termCount)
+{
+    // Function to check that the postings of a book can be decoded without reading past their end
+    // @param: book - the book read from the snapshot
+    // @param: termCount - the size of the vocabulary
+    uint64_t positions = 0;
+    for (size_t i = 0; i < book.postingTerms.size(); i++)
+    {
+        if (book.postingTerms[i] >= termCount || book.postingStarts[i] > book.postingStarts[i + 1])
+        {
+            return false;
+        }
+        positions += book.postingCounts[i];
+    }
+
+    return positions == book.tokens.size() && book.postingStarts.back() == book.postingData.size() && (book.postingData.size() == 0 || book.postingData.back() < 0x80);
+}
+
+int parseSnapshot(const char *data, size_t size, searchIndex &index)
+{
+    // Function to fill the index from a snapshot
+    // @param: data - the snapshot
+    // @param: size - the size of the snapshot in bytes
+    // @param: index - the index to fill, the caller has to hold its mutex exclusively
+    clearIndex(index);
+
+    if (size < sizeof(snapshotMagic) + sizeof(uint64_t) || std::memcmp(data, snapshotMagic, sizeof(snapshotMagic)) != 0)
+    {
+        return 1;
+    }
+
+    uint64_t checksum;
+    std::memcpy(&checksum, data + size - sizeof(uint64_t), sizeof(uint64_t));
+    if (checksum != fnv1a(data, size - sizeof(uint64_t)))
+    {
+        return 1;
+    }
+
+    snapshotReader reader{data, size - sizeof(uint64_t), sizeof(snapshotMagic)};
+    if (reader.readValue<uint32_t>() != snapshotVersion)
+    {
+        return 1;
+    }
+
+    index.databaseId = reader.readString();
+    index.generation = reader.readValue<int64_t>();
+
+    uint64_t termCount = reader.readValue<uint64_t>();
+    for (uint64_t i = 0; i < termCount && !reader.failed; i++)
+    {
+        std::vector<char32_t> codePoints;
+        reader.readVector(codePoints, reader.readValue<uint32_t>());
+        index.terms.emplace_back(codePoints.begin(), codePoints.end());
+        index.termIds.emplace(index.terms.back(), i);
+    }
+    index.stats.resize(index.terms.size());
+
+    uint64_t bookCount = reader.readValue<uint64_t>();
+    for (uint64_t i = 0; i < bookCount && !reader.failed; i++)
+    {
+        long long rowId = reader.readValue<int64_t>();
+
+        indexedBook book;
+        book.generation = reader.readValue<int64_t>();
+        book.bookId = reader.readString();
+        book.bookName = reader.readString();
+        uint64_t tokenCount = reader.readValue<uint64_t>();
+        reader.readVector(book.tokens, tokenCount);
+        reader.readVector(book.offsets, tokenCount + 1);
+        uint64_t postingTermCount = reader.readValue<uint64_t>();
+        reader.readVector(book.postingTerms, postingTermCount);
+        reader.readVector(book.postingCounts, postingTermCount);
+        reader.readVector(book.postingStarts, postingTermCount + 1);
+        reader.readVector(book.postingData, reader.readValue<uint64_t>());
+
+        if (reader.failed || !validPostings(book, index.terms.size()))
+        {
+            return 1;
+        }
+        for (auto token : book.tokens)
+        {
+            if (token >= index.terms.size())
+            {
+                return 1;
+            }
+        }
+
+        // The statistics aren't stored, they are counted again from the postings
+        addIndexedBook(index, rowId, std::move(book));
+    }
+
+    if (reader.failed || reader.pos != reader.size)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+int loadSnapshot(searchIndex &index, std::string path)
+{
+    // Function to load a snapshot into the index, the file is mapped instead of read
+    // @param: index - the index
+    // @param: path - the file to load
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return 1;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        return 1;
+    }
+
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        return 1;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    std::unique_lock<std::shared_timed_mutex> lock(index.mutex);
+    int rc = parseSnapshot(static_cast<const char *>(data), info.st_size, index);
+    munmap(data, info.st_size);
+
+    if (rc != 0)
+    {
+        // Don't keep half a snapshot around
+        clearIndex(index);
+    }
+
+    return rc;
+}
+
+int initIndex(sqlite3 *db, searchIndex &index, std::string path)
+{
+    // Function to get the index up to date at startup
+    // A valid snapshot is loaded and only the changes made after it are applied, otherwise the index is rebuilt
+    // @param: db - the database
+    // @param: index - the index
+    // @param: path - the snapshot to load
+    if (loadSnapshot(index, path) != 0)
+    {
+        std::cout << "No valid snapshot, building the index" << std::endl;
+        return rebuildIndex(db, index);
+    }
+
+    // A snapshot of another database, e.g. before a restored or replaced file, or newer than the database can't be brought up to date
+    if (index.databaseId != getDatabaseId(db) || index.generation > getGeneration(db))
+    {
+        std::cout << "Snapshot doesn't match the database, building the index" << std::endl;
+        return rebuildIndex(db, index);
+    }
+
+    std::cout << "Loaded snapshot at generation " << index.generation << ", applying changes since" << std::endl;
+    if (syncIndex(db, index) != 0 || (long long)index.books.size() != countBooks(db))
+    {
+        std::cout << "Index doesn't match the database after applying changes, building the index" << std::endl;
+        return rebuildIndex(db, index);
+    }
+
+    return 0;
+}
+
+// struct controlling the thread which writes snapshots periodically
+struct snapshotScheduler {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop = false;
+    // generation of the last snapshot written, so unchanged indexes aren't written again
+    long long writtenGeneration = -1;
+    // compactions of the index at the last snapshot, compacting changes the term ids without a new generation
+    long long writtenCompactions = 0;
+};
+
+int writeSnapshotIfChanged(searchIndex &index, std::string path, snapshotScheduler &scheduler)
+{
+    // Function to write a snapshot if the index changed since the last one
+    // @param: index - the index
+    // @param: path - the file to write to
+    // @param: scheduler - the scheduler remembering the last snapshot
+    long long generation;
+    long long compactions;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(index.mutex);
+        generation = index.generation;
+        compactions = index.compactions;
+    }
+
+    if (generation == scheduler.writtenGeneration && compactions == scheduler.writtenCompactions)
+    {
+        return 0;
+    }
+
+    int rc = writeSnapshot(index, path);
+    if (rc == 0)
+    {
+        scheduler.writtenGeneration = generation;
+        scheduler.writtenCompactions = compactions;
+    }
+    return rc;
+}
+
+void startSnapshots(searchIndex &index, std::string path, int intervalSeconds, snapshotScheduler &scheduler)
+{
+    // Function to start writing snapshots every intervalSeconds
+    // @param: index - the index
+    // @param: path - the file to write to
+    // @param: intervalSeconds - the time between two snapshots
+    // @param: scheduler - the scheduler to run the thread on
+    scheduler.thread = std::thread([&index, path, intervalSeconds, &scheduler]() {
+        std::unique_lock<std::mutex> lock(scheduler.mutex);
+        while (!scheduler.wake.wait_for(lock, std::chrono::seconds(intervalSeconds), [&scheduler] { return scheduler.stop; }))
+        {
+            if (writeSnapshotIfChanged(index, path, scheduler) != 0)
+            {
+                std::cout << "Failed to write snapshot to " << path << std::endl;
+            }
+        }
+    });
+}
+
+void stopSnapshots(searchIndex &index, std::string path, snapshotScheduler &scheduler)
+{
+    // Function to stop the snapshot thread and write a last snapshot
+    // @param: index - the index
+    // @param: path - the file to write to
+    // @param: scheduler - the scheduler running the thread
+    {
+        std::lock_guard<std::mutex> lock(scheduler.mutex);
+        scheduler.stop = true;
+    }
+    scheduler.wake.notify_all();
+    if (scheduler.thread.joinable())
+    {
+        scheduler.thread.join();
+    }
+
+    if (writeSnapshotIfChanged(index, path, scheduler) != 0)
+    {
+        std::cout << "Failed to write snapshot to " << path << std::endl;
+    }
+}
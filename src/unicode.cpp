@@ -0,0 +1,401 @@
+#include <string>
+#include <cstdint>
+#include <cctype>
+
+// Tables folding a code point to its lower case form without diacritics, using compatibility forms (NFKC)
+// A value of 0 drops the code point (punctuation, symbols, spaces and combining marks), 0xFFFF means it
+// folds to more than one code point, see foldExpansions.
+// Generated from the Unicode 14 character database: NFKD(casefold(NFKC(c))) without marks.
+
+struct foldExpansion {
+    uint16_t codePoint;
+    uint16_t folded[3];
+};
+
+struct foldBlock {
+    char32_t first;
+    // exclusive
+    char32_t last;
+    const uint16_t *table;
+};
+
+// Latin-1 Supplement to Cyrillic Supplement, U+0080 to U+052F
+static const uint16_t foldTable0080[1200] = {
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0061, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0032, 0x0033, 0x0000, 0x03BC, 0x0000, 0x0000, 0x0000, 0x0031, 0x006F, 0x0000,
+    0xFFFF, 0xFFFF, 0xFFFF, 0x0000, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x00E6, 0x0063,
+    0x0065, 0x0065, 0x0065, 0x0065, 0x0069, 0x0069, 0x0069, 0x0069, 0x00F0, 0x006E, 0x006F, 0x006F,
+    0x006F, 0x006F, 0x006F, 0x0000, 0x00F8, 0x0075, 0x0075, 0x0075, 0x0075, 0x0079, 0x00FE, 0xFFFF,
+    0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x00E6, 0x0063, 0x0065, 0x0065, 0x0065, 0x0065,
+    0x0069, 0x0069, 0x0069, 0x0069, 0x00F0, 0x006E, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x0000,
+    0x00F8, 0x0075, 0x0075, 0x0075, 0x0075, 0x0079, 0x00FE, 0x0079, 0x0061, 0x0061, 0x0061, 0x0061,
+    0x0061, 0x0061, 0x0063, 0x0063, 0x0063, 0x0063, 0x0063, 0x0063, 0x0063, 0x0063, 0x0064, 0x0064,
+    0x0111, 0x0111, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065,
+    0x0067, 0x0067, 0x0067, 0x0067, 0x0067, 0x0067, 0x0067, 0x0067, 0x0068, 0x0068, 0x0127, 0x0127,
+    0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0131, 0xFFFF, 0xFFFF,
+    0x006A, 0x006A, 0x006B, 0x006B, 0x0138, 0x006C, 0x006C, 0x006C, 0x006C, 0x006C, 0x006C, 0x006C,
+    0x006C, 0x0142, 0x0142, 0x006E, 0x006E, 0x006E, 0x006E, 0x006E, 0x006E, 0xFFFF, 0x014B, 0x014B,
+    0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x0153, 0x0153, 0x0072, 0x0072, 0x0072, 0x0072,
+    0x0072, 0x0072, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0074, 0x0074,
+    0x0074, 0x0074, 0x0167, 0x0167, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+    0x0075, 0x0075, 0x0075, 0x0075, 0x0077, 0x0077, 0x0079, 0x0079, 0x0079, 0x007A, 0x007A, 0x007A,
+    0x007A, 0x007A, 0x007A, 0x0073, 0x0180, 0x0253, 0x0183, 0x0183, 0x0185, 0x0185, 0x0254, 0x0188,
+    0x0188, 0x0256, 0x0257, 0x018C, 0x018C, 0x018D, 0x01DD, 0x0259, 0x025B, 0x0192, 0x0192, 0x0260,
+    0x0263, 0x0195, 0x0269, 0x0268, 0x0199, 0x0199, 0x019A, 0x019B, 0x026F, 0x0272, 0x019E, 0x0275,
+    0x006F, 0x006F, 0x01A3, 0x01A3, 0x01A5, 0x01A5, 0x0280, 0x01A8, 0x01A8, 0x0283, 0x01AA, 0x01AB,
+    0x01AD, 0x01AD, 0x0288, 0x0075, 0x0075, 0x028A, 0x028B, 0x01B4, 0x01B4, 0x01B6, 0x01B6, 0x0292,
+    0x01B9, 0x01B9, 0x01BA, 0x01BB, 0x01BD, 0x01BD, 0x01BE, 0x01BF, 0x01C0, 0x01C1, 0x01C2, 0x01C3,
+    0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0x0061, 0x0061, 0x0069,
+    0x0069, 0x006F, 0x006F, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+    0x0075, 0x01DD, 0x0061, 0x0061, 0x0061, 0x0061, 0x00E6, 0x00E6, 0x01E5, 0x01E5, 0x0067, 0x0067,
+    0x006B, 0x006B, 0x006F, 0x006F, 0x006F, 0x006F, 0x0292, 0x0292, 0x006A, 0xFFFF, 0xFFFF, 0xFFFF,
+    0x0067, 0x0067, 0x0195, 0x01BF, 0x006E, 0x006E, 0x0061, 0x0061, 0x00E6, 0x00E6, 0x00F8, 0x00F8,
+    0x0061, 0x0061, 0x0061, 0x0061, 0x0065, 0x0065, 0x0065, 0x0065, 0x0069, 0x0069, 0x0069, 0x0069,
+    0x006F, 0x006F, 0x006F, 0x006F, 0x0072, 0x0072, 0x0072, 0x0072, 0x0075, 0x0075, 0x0075, 0x0075,
+    0x0073, 0x0073, 0x0074, 0x0074, 0x021D, 0x021D, 0x0068, 0x0068, 0x019E, 0x0221, 0x0223, 0x0223,
+    0x0225, 0x0225, 0x0061, 0x0061, 0x0065, 0x0065, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F,
+    0x006F, 0x006F, 0x0079, 0x0079, 0x0234, 0x0235, 0x0236, 0x0237, 0x0238, 0x0239, 0x2C65, 0x023C,
+    0x023C, 0x019A, 0x2C66, 0x023F, 0x0240, 0x0242, 0x0242, 0x0180, 0x0289, 0x028C, 0x0247, 0x0247,
+    0x0249, 0x0249, 0x024B, 0x024B, 0x024D, 0x024D, 0x024F, 0x024F, 0x0250, 0x0251, 0x0252, 0x0253,
+    0x0254, 0x0255, 0x0256, 0x0257, 0x0258, 0x0259, 0x025A, 0x025B, 0x025C, 0x025D, 0x025E, 0x025F,
+    0x0260, 0x0261, 0x0262, 0x0263, 0x0264, 0x0265, 0x0266, 0x0267, 0x0268, 0x0269, 0x026A, 0x026B,
+    0x026C, 0x026D, 0x026E, 0x026F, 0x0270, 0x0271, 0x0272, 0x0273, 0x0274, 0x0275, 0x0276, 0x0277,
+    0x0278, 0x0279, 0x027A, 0x027B, 0x027C, 0x027D, 0x027E, 0x027F, 0x0280, 0x0281, 0x0282, 0x0283,
+    0x0284, 0x0285, 0x0286, 0x0287, 0x0288, 0x0289, 0x028A, 0x028B, 0x028C, 0x028D, 0x028E, 0x028F,
+    0x0290, 0x0291, 0x0292, 0x0293, 0x0294, 0x0295, 0x0296, 0x0297, 0x0298, 0x0299, 0x029A, 0x029B,
+    0x029C, 0x029D, 0x029E, 0x029F, 0x02A0, 0x02A1, 0x02A2, 0x02A3, 0x02A4, 0x02A5, 0x02A6, 0x02A7,
+    0x02A8, 0x02A9, 0x02AA, 0x02AB, 0x02AC, 0x02AD, 0x02AE, 0x02AF, 0x0068, 0x0266, 0x006A, 0x0072,
+    0x0279, 0x027B, 0x0281, 0x0077, 0x0079, 0x02B9, 0x02BA, 0x02BB, 0x02BC, 0x02BD, 0x02BE, 0x02BF,
+    0x02C0, 0x02C1, 0x0000, 0x0000, 0x0000, 0x0000, 0x02C6, 0x02C7, 0x02C8, 0x02C9, 0x02CA, 0x02CB,
+    0x02CC, 0x02CD, 0x02CE, 0x02CF, 0x02D0, 0x02D1, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0263, 0x006C, 0x0073, 0x0078,
+    0x0295, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x02EC, 0x0000, 0x02EE, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0371, 0x0371, 0x0373, 0x0373,
+    0x02B9, 0x0000, 0x0377, 0x0377, 0x0000, 0x0000, 0x03B9, 0x037B, 0x037C, 0x037D, 0x0000, 0x03F3,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x03B1, 0x0000, 0x03B5, 0x03B7, 0x03B9, 0x0000,
+    0x03BF, 0x0000, 0x03C5, 0x03C9, 0x03B9, 0x03B1, 0x03B2, 0x03B3, 0x03B4, 0x03B5, 0x03B6, 0x03B7,
+    0x03B8, 0x03B9, 0x03BA, 0x03BB, 0x03BC, 0x03BD, 0x03BE, 0x03BF, 0x03C0, 0x03C1, 0x0000, 0x03C3,
+    0x03C4, 0x03C5, 0x03C6, 0x03C7, 0x03C8, 0x03C9, 0x03B9, 0x03C5, 0x03B1, 0x03B5, 0x03B7, 0x03B9,
+    0x03C5, 0x03B1, 0x03B2, 0x03B3, 0x03B4, 0x03B5, 0x03B6, 0x03B7, 0x03B8, 0x03B9, 0x03BA, 0x03BB,
+    0x03BC, 0x03BD, 0x03BE, 0x03BF, 0x03C0, 0x03C1, 0x03C3, 0x03C3, 0x03C4, 0x03C5, 0x03C6, 0x03C7,
+    0x03C8, 0x03C9, 0x03B9, 0x03C5, 0x03BF, 0x03C5, 0x03C9, 0x03D7, 0x03B2, 0x03B8, 0x03C5, 0x03C5,
+    0x03C5, 0x03C6, 0x03C0, 0x03D7, 0x03D9, 0x03D9, 0x03DB, 0x03DB, 0x03DD, 0x03DD, 0x03DF, 0x03DF,
+    0x03E1, 0x03E1, 0x03E3, 0x03E3, 0x03E5, 0x03E5, 0x03E7, 0x03E7, 0x03E9, 0x03E9, 0x03EB, 0x03EB,
+    0x03ED, 0x03ED, 0x03EF, 0x03EF, 0x03BA, 0x03C1, 0x03C3, 0x03F3, 0x03B8, 0x03B5, 0x0000, 0x03F8,
+    0x03F8, 0x03C3, 0x03FB, 0x03FB, 0x03FC, 0x037B, 0x037C, 0x037D, 0x0435, 0x0435, 0x0452, 0x0433,
+    0x0454, 0x0455, 0x0456, 0x0456, 0x0458, 0x0459, 0x045A, 0x045B, 0x043A, 0x0438, 0x0443, 0x045F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437, 0x0438, 0x0438, 0x043A, 0x043B,
+    0x043C, 0x043D, 0x043E, 0x043F, 0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F, 0x0430, 0x0431, 0x0432, 0x0433,
+    0x0434, 0x0435, 0x0436, 0x0437, 0x0438, 0x0438, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447, 0x0448, 0x0449, 0x044A, 0x044B,
+    0x044C, 0x044D, 0x044E, 0x044F, 0x0435, 0x0435, 0x0452, 0x0433, 0x0454, 0x0455, 0x0456, 0x0456,
+    0x0458, 0x0459, 0x045A, 0x045B, 0x043A, 0x0438, 0x0443, 0x045F, 0x0461, 0x0461, 0x0463, 0x0463,
+    0x0465, 0x0465, 0x0467, 0x0467, 0x0469, 0x0469, 0x046B, 0x046B, 0x046D, 0x046D, 0x046F, 0x046F,
+    0x0471, 0x0471, 0x0473, 0x0473, 0x0475, 0x0475, 0x0475, 0x0475, 0x0479, 0x0479, 0x047B, 0x047B,
+    0x047D, 0x047D, 0x047F, 0x047F, 0x0481, 0x0481, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x048B, 0x048B, 0x048D, 0x048D, 0x048F, 0x048F, 0x0491, 0x0491, 0x0493, 0x0493,
+    0x0495, 0x0495, 0x0497, 0x0497, 0x0499, 0x0499, 0x049B, 0x049B, 0x049D, 0x049D, 0x049F, 0x049F,
+    0x04A1, 0x04A1, 0x04A3, 0x04A3, 0x04A5, 0x04A5, 0x04A7, 0x04A7, 0x04A9, 0x04A9, 0x04AB, 0x04AB,
+    0x04AD, 0x04AD, 0x04AF, 0x04AF, 0x04B1, 0x04B1, 0x04B3, 0x04B3, 0x04B5, 0x04B5, 0x04B7, 0x04B7,
+    0x04B9, 0x04B9, 0x04BB, 0x04BB, 0x04BD, 0x04BD, 0x04BF, 0x04BF, 0x04CF, 0x0436, 0x0436, 0x04C4,
+    0x04C4, 0x04C6, 0x04C6, 0x04C8, 0x04C8, 0x04CA, 0x04CA, 0x04CC, 0x04CC, 0x04CE, 0x04CE, 0x04CF,
+    0x0430, 0x0430, 0x0430, 0x0430, 0x04D5, 0x04D5, 0x0435, 0x0435, 0x04D9, 0x04D9, 0x04D9, 0x04D9,
+    0x0436, 0x0436, 0x0437, 0x0437, 0x04E1, 0x04E1, 0x0438, 0x0438, 0x0438, 0x0438, 0x043E, 0x043E,
+    0x04E9, 0x04E9, 0x04E9, 0x04E9, 0x044D, 0x044D, 0x0443, 0x0443, 0x0443, 0x0443, 0x0443, 0x0443,
+    0x0447, 0x0447, 0x04F7, 0x04F7, 0x044B, 0x044B, 0x04FB, 0x04FB, 0x04FD, 0x04FD, 0x04FF, 0x04FF,
+    0x0501, 0x0501, 0x0503, 0x0503, 0x0505, 0x0505, 0x0507, 0x0507, 0x0509, 0x0509, 0x050B, 0x050B,
+    0x050D, 0x050D, 0x050F, 0x050F, 0x0511, 0x0511, 0x0513, 0x0513, 0x0515, 0x0515, 0x0517, 0x0517,
+    0x0519, 0x0519, 0x051B, 0x051B, 0x051D, 0x051D, 0x051F, 0x051F, 0x0521, 0x0521, 0x0523, 0x0523,
+    0x0525, 0x0525, 0x0527, 0x0527, 0x0529, 0x0529, 0x052B, 0x052B, 0x052D, 0x052D, 0x052F, 0x052F,
+};
+
+// Latin Extended Additional and Greek Extended, U+1E00 to U+1FFF
+static const uint16_t foldTable1E00[512] = {
+    0x0061, 0x0061, 0x0062, 0x0062, 0x0062, 0x0062, 0x0062, 0x0062, 0x0063, 0x0063, 0x0064, 0x0064,
+    0x0064, 0x0064, 0x0064, 0x0064, 0x0064, 0x0064, 0x0064, 0x0064, 0x0065, 0x0065, 0x0065, 0x0065,
+    0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0066, 0x0066, 0x0067, 0x0067, 0x0068, 0x0068,
+    0x0068, 0x0068, 0x0068, 0x0068, 0x0068, 0x0068, 0x0068, 0x0068, 0x0069, 0x0069, 0x0069, 0x0069,
+    0x006B, 0x006B, 0x006B, 0x006B, 0x006B, 0x006B, 0x006C, 0x006C, 0x006C, 0x006C, 0x006C, 0x006C,
+    0x006C, 0x006C, 0x006D, 0x006D, 0x006D, 0x006D, 0x006D, 0x006D, 0x006E, 0x006E, 0x006E, 0x006E,
+    0x006E, 0x006E, 0x006E, 0x006E, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F,
+    0x0070, 0x0070, 0x0070, 0x0070, 0x0072, 0x0072, 0x0072, 0x0072, 0x0072, 0x0072, 0x0072, 0x0072,
+    0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0074, 0x0074,
+    0x0074, 0x0074, 0x0074, 0x0074, 0x0074, 0x0074, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+    0x0075, 0x0075, 0x0075, 0x0075, 0x0076, 0x0076, 0x0076, 0x0076, 0x0077, 0x0077, 0x0077, 0x0077,
+    0x0077, 0x0077, 0x0077, 0x0077, 0x0077, 0x0077, 0x0078, 0x0078, 0x0078, 0x0078, 0x0079, 0x0079,
+    0x007A, 0x007A, 0x007A, 0x007A, 0x007A, 0x007A, 0x0068, 0x0074, 0x0077, 0x0079, 0xFFFF, 0x0073,
+    0x1E9C, 0x1E9D, 0xFFFF, 0x1E9F, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061,
+    0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061,
+    0x0061, 0x0061, 0x0061, 0x0061, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065,
+    0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0069, 0x0069, 0x0069, 0x0069,
+    0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F,
+    0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F, 0x006F,
+    0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+    0x0075, 0x0075, 0x0079, 0x0079, 0x0079, 0x0079, 0x0079, 0x0079, 0x0079, 0x0079, 0x1EFB, 0x1EFB,
+    0x1EFD, 0x1EFD, 0x1EFF, 0x1EFF, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1,
+    0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B1, 0x03B5, 0x03B5, 0x03B5, 0x03B5,
+    0x03B5, 0x03B5, 0x0000, 0x0000, 0x03B5, 0x03B5, 0x03B5, 0x03B5, 0x03B5, 0x03B5, 0x0000, 0x0000,
+    0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B7,
+    0x03B7, 0x03B7, 0x03B7, 0x03B7, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9,
+    0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03BF, 0x03BF, 0x03BF, 0x03BF,
+    0x03BF, 0x03BF, 0x0000, 0x0000, 0x03BF, 0x03BF, 0x03BF, 0x03BF, 0x03BF, 0x03BF, 0x0000, 0x0000,
+    0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x0000, 0x03C5, 0x0000, 0x03C5,
+    0x0000, 0x03C5, 0x0000, 0x03C5, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9,
+    0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03C9, 0x03B1, 0x03B1, 0x03B5, 0x03B5,
+    0x03B7, 0x03B7, 0x03B9, 0x03B9, 0x03BF, 0x03BF, 0x03C5, 0x03C5, 0x03C9, 0x03C9, 0x0000, 0x0000,
+    0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+    0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+    0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+    0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+    0x03B1, 0x03B1, 0xFFFF, 0xFFFF, 0xFFFF, 0x0000, 0x03B1, 0xFFFF, 0x03B1, 0x03B1, 0x03B1, 0x03B1,
+    0xFFFF, 0x0000, 0x03B9, 0x0000, 0x0000, 0x0000, 0xFFFF, 0xFFFF, 0xFFFF, 0x0000, 0x03B7, 0xFFFF,
+    0x03B5, 0x03B5, 0x03B7, 0x03B7, 0xFFFF, 0x0000, 0x0000, 0x0000, 0x03B9, 0x03B9, 0x03B9, 0x03B9,
+    0x0000, 0x0000, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x03B9, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x03C1, 0x03C1, 0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x03C5, 0x03C5,
+    0x03C1, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0xFFFF, 0xFFFF, 0xFFFF, 0x0000, 0x03C9, 0xFFFF,
+    0x03BF, 0x03BF, 0x03C9, 0x03C9, 0xFFFF, 0x0000, 0x0000, 0x0000,
+};
+
+// General Punctuation, U+2000 to U+206F
+static const uint16_t foldTable2000[112] = {
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000,
+};
+
+// Latin ligatures, U+FB00 to U+FB06
+static const uint16_t foldTableFB00[7] = {
+    0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+};
+
+// Fullwidth forms, U+FF00 to U+FF65
+static const uint16_t foldTableFF00[102] = {
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0061, 0x0062, 0x0063,
+    0x0064, 0x0065, 0x0066, 0x0067, 0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F, 0x0070, 0x0071, 0x0072, 0x0073,
+    0x0074, 0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+};
+
+// code points folding to more than one code point, marked with 0xFFFF in the tables above
+static const foldExpansion foldExpansions[91] = {
+    {0x00BC, {0x0031, 0x0034}},
+    {0x00BD, {0x0031, 0x0032}},
+    {0x00BE, {0x0033, 0x0034}},
+    {0x00DF, {0x0073, 0x0073}},
+    {0x0132, {0x0069, 0x006A}},
+    {0x0133, {0x0069, 0x006A}},
+    {0x0149, {0x02BC, 0x006E}},
+    {0x01C4, {0x0064, 0x007A}},
+    {0x01C5, {0x0064, 0x007A}},
+    {0x01C6, {0x0064, 0x007A}},
+    {0x01C7, {0x006C, 0x006A}},
+    {0x01C8, {0x006C, 0x006A}},
+    {0x01C9, {0x006C, 0x006A}},
+    {0x01CA, {0x006E, 0x006A}},
+    {0x01CB, {0x006E, 0x006A}},
+    {0x01CC, {0x006E, 0x006A}},
+    {0x01F1, {0x0064, 0x007A}},
+    {0x01F2, {0x0064, 0x007A}},
+    {0x01F3, {0x0064, 0x007A}},
+    {0x1E9A, {0x0061, 0x02BE}},
+    {0x1E9E, {0x0073, 0x0073}},
+    {0x1F80, {0x03B1, 0x03B9}},
+    {0x1F81, {0x03B1, 0x03B9}},
+    {0x1F82, {0x03B1, 0x03B9}},
+    {0x1F83, {0x03B1, 0x03B9}},
+    {0x1F84, {0x03B1, 0x03B9}},
+    {0x1F85, {0x03B1, 0x03B9}},
+    {0x1F86, {0x03B1, 0x03B9}},
+    {0x1F87, {0x03B1, 0x03B9}},
+    {0x1F88, {0x03B1, 0x03B9}},
+    {0x1F89, {0x03B1, 0x03B9}},
+    {0x1F8A, {0x03B1, 0x03B9}},
+    {0x1F8B, {0x03B1, 0x03B9}},
+    {0x1F8C, {0x03B1, 0x03B9}},
+    {0x1F8D, {0x03B1, 0x03B9}},
+    {0x1F8E, {0x03B1, 0x03B9}},
+    {0x1F8F, {0x03B1, 0x03B9}},
+    {0x1F90, {0x03B7, 0x03B9}},
+    {0x1F91, {0x03B7, 0x03B9}},
+    {0x1F92, {0x03B7, 0x03B9}},
+    {0x1F93, {0x03B7, 0x03B9}},
+    {0x1F94, {0x03B7, 0x03B9}},
+    {0x1F95, {0x03B7, 0x03B9}},
+    {0x1F96, {0x03B7, 0x03B9}},
+    {0x1F97, {0x03B7, 0x03B9}},
+    {0x1F98, {0x03B7, 0x03B9}},
+    {0x1F99, {0x03B7, 0x03B9}},
+    {0x1F9A, {0x03B7, 0x03B9}},
+    {0x1F9B, {0x03B7, 0x03B9}},
+    {0x1F9C, {0x03B7, 0x03B9}},
+    {0x1F9D, {0x03B7, 0x03B9}},
+    {0x1F9E, {0x03B7, 0x03B9}},
+    {0x1F9F, {0x03B7, 0x03B9}},
+    {0x1FA0, {0x03C9, 0x03B9}},
+    {0x1FA1, {0x03C9, 0x03B9}},
+    {0x1FA2, {0x03C9, 0x03B9}},
+    {0x1FA3, {0x03C9, 0x03B9}},
+    {0x1FA4, {0x03C9, 0x03B9}},
+    {0x1FA5, {0x03C9, 0x03B9}},
+    {0x1FA6, {0x03C9, 0x03B9}},
+    {0x1FA7, {0x03C9, 0x03B9}},
+    {0x1FA8, {0x03C9, 0x03B9}},
+    {0x1FA9, {0x03C9, 0x03B9}},
+    {0x1FAA, {0x03C9, 0x03B9}},
+    {0x1FAB, {0x03C9, 0x03B9}},
+    {0x1FAC, {0x03C9, 0x03B9}},
+    {0x1FAD, {0x03C9, 0x03B9}},
+    {0x1FAE, {0x03C9, 0x03B9}},
+    {0x1FAF, {0x03C9, 0x03B9}},
+    {0x1FB2, {0x03B1, 0x03B9}},
+    {0x1FB3, {0x03B1, 0x03B9}},
+    {0x1FB4, {0x03B1, 0x03B9}},
+    {0x1FB7, {0x03B1, 0x03B9}},
+    {0x1FBC, {0x03B1, 0x03B9}},
+    {0x1FC2, {0x03B7, 0x03B9}},
+    {0x1FC3, {0x03B7, 0x03B9}},
+    {0x1FC4, {0x03B7, 0x03B9}},
+    {0x1FC7, {0x03B7, 0x03B9}},
+    {0x1FCC, {0x03B7, 0x03B9}},
+    {0x1FF2, {0x03C9, 0x03B9}},
+    {0x1FF3, {0x03C9, 0x03B9}},
+    {0x1FF4, {0x03C9, 0x03B9}},
+    {0x1FF7, {0x03C9, 0x03B9}},
+    {0x1FFC, {0x03C9, 0x03B9}},
+    {0xFB00, {0x0066, 0x0066}},
+    {0xFB01, {0x0066, 0x0069}},
+    {0xFB02, {0x0066, 0x006C}},
+    {0xFB03, {0x0066, 0x0066, 0x0069}},
+    {0xFB04, {0x0066, 0x0066, 0x006C}},
+    {0xFB05, {0x0073, 0x0074}},
+    {0xFB06, {0x0073, 0x0074}},
+};
+
+static const foldBlock foldBlocks[5] = {
+    {0x0080, 0x0530, foldTable0080},
+    {0x1E00, 0x2000, foldTable1E00},
+    {0x2000, 0x2070, foldTable2000},
+    {0xFB00, 0xFB07, foldTableFB00},
+    {0xFF00, 0xFF66, foldTableFF00},
+};
+
+char32_t decodeUtf8(const std::string &text, size_t &i)
+{
+    // Function to read the code point starting at byte i and move i behind it
+    // Invalid sequences are read as a single Latin-1 byte, so text in other encodings is not thrown away
+    // @param: text - the UTF-8 text
+    // @param: i - the byte offset to read at
+    unsigned char c = text[i];
+    int length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+
+    if (length <= 1 || i + length > text.size())
+    {
+        i++;
+        return c;
+    }
+
+    char32_t codePoint = c & (0xFF >> (length + 1));
+    for (int j = 1; j < length; j++)
+    {
+        unsigned char next = text[i + j];
+        if ((next >> 6) != 0x2)
+        {
+            i++;
+            return c;
+        }
+        codePoint = (codePoint << 6) | (next & 0x3F);
+    }
+
+    i += length;
+    return codePoint;
+}
+
+void appendFolded(std::u32string &result, char32_t codePoint)
+{
+    // Function to append the folded form of a code point
+    // @param: result - the code points to append to
+    // @param: codePoint - the code point to fold
+    if (codePoint < 0x80)
+    {
+        if (!std::ispunct(codePoint))
+            result += (char32_t)std::tolower(codePoint);
+        return;
+    }
+
+    for (auto &block : foldBlocks)
+    {
+        if (codePoint < block.first || codePoint >= block.last)
+        {
+            continue;
+        }
+
+        uint16_t folded = block.table[codePoint - block.first];
+        if (folded == 0xFFFF)
+        {
+            for (auto &expansion : foldExpansions)
+            {
+                if (expansion.codePoint != codePoint)
+                {
+                    continue;
+                }
+                for (auto c : expansion.folded)
+                {
+                    if (c != 0)
+                        result += (char32_t)c;
+                }
+                return;
+            }
+        }
+        else if (folded != 0)
+        {
+            result += (char32_t)folded;
+        }
+        return;
+    }
+
+    // Everything outside the tables is kept as it is: CJK has no case, but e.g. Armenian and Georgian only match in the same case
+    // and Hebrew and Arabic marks or combining marks outside U+0300 to U+036F are not dropped
+    result += codePoint;
+}
+
+std::u32string foldWord(const std::string &word)
+{
+    // Function to fold a UTF-8 word into lower case code points without diacritics and punctuation
+    // @param: word - the word to fold
+    std::u32string result;
+    result.reserve(word.size());
+
+    size_t i = 0;
+    while (i < word.size())
+    {
+        appendFolded(result, decodeUtf8(word, i));
+    }
+
+    return result;
+}
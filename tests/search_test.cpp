@@ -0,0 +1,147 @@
+// Regression tests for the parts of the server which don't need restbed, run with `make test`
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include "../src/db.cpp"
+#include "../src/index.cpp"
+#include "../src/snapshot.cpp"
+#include "../src/search.cpp"
+
+int failures = 0;
+
+void check(std::string name, bool passed)
+{
+    // Function to report the result of a test
+    // @param: name - the name of the test
+    // @param: passed - whether the test passed
+    std::cout << (passed ? "PASS " : "FAIL ") << name << std::endl;
+    if (!passed)
+    {
+        failures++;
+    }
+}
+
+sqlite3 *openTestDB(std::string path)
+{
+    // Function to open an empty database with every table of the server
+    // @param: path - the file of the database
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+
+    sqlite3 *db;
+    sqlite3_open(path.c_str(), &db);
+    configureStorage(db);
+    createTable(db);
+    createChangesTable(db);
+    createIdentityTable(db);
+    return db;
+}
+
+size_t countHits(sqlite3 *db, searchIndex &index, std::string query)
+{
+    // Function to count the hits of a query in every book
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: query - the query text
+    auto parsed = parseQuery(query);
+    if (parsed.errorCode != 0)
+    {
+        return 0;
+    }
+    return searchAllBooksQuery(db, index, parsed.root, false, 15, 100000, false).results.size();
+}
+
+void testNegationAfterCostlyOr()
+{
+    // A NOT side has to filter the other side even when that side is estimated to be more expensive
+    sqlite3 *db = openTestDB("./tests/negation.db");
+    searchIndex index;
+    // Short words in nearly every position are estimated as expensive, six of them in an OR cost more than the NOT side
+    writeIndexed(db, index, [&] { return addBook(db, "1", "Letters", "a a a a a a a a"); });
+    writeIndexed(db, index, [&] { return addBook(db, "2", "Zoo", "a a a a zebra"); });
+
+    check("NOT after a phrase", countHits(db, index, "a AND NOT zebra") == 8);
+    check("NOT after a costly OR", countHits(db, index, "(a OR a OR a OR a OR a OR a) AND NOT zebra") == 8);
+    check("NOT before a costly OR", countHits(db, index, "NOT zebra AND (a OR a OR a OR a OR a OR a)") == 8);
+
+    sqlite3_close(db);
+}
+
+void testSnapshotOfAnotherDatabase()
+{
+    // A snapshot must not be loaded for another database, even one with as many books and a generation at least as high
+    sqlite3 *first = openTestDB("./tests/first.db");
+    sqlite3 *second = openTestDB("./tests/second.db");
+    addBook(first, "1", "First", "whale sea ship");
+    addBook(second, "1", "Second", "zebra savanna lion");
+
+    searchIndex index;
+    rebuildIndex(first, index);
+    check("snapshot written", writeSnapshot(index, "./tests/first.snapshot") == 0);
+
+    searchIndex loaded;
+    check("snapshot of the same database loaded", initIndex(first, loaded, "./tests/first.snapshot") == 0 && loaded.databaseId == getDatabaseId(first));
+
+    searchIndex other;
+    check("index of another database rebuilt", initIndex(second, other, "./tests/first.snapshot") == 0 && other.databaseId == getDatabaseId(second));
+    check("index of another database has its books", countHits(second, other, "zebra") == 1 && countHits(second, other, "whale") == 0);
+
+    sqlite3_close(first);
+    sqlite3_close(second);
+    std::remove("./tests/first.snapshot");
+}
+
+size_t followPages(sqlite3 *db, searchIndex &index, std::string query, std::string bookId)
+{
+    // Function to follow the cursors of a paginated search whose time is always up, until the last page
+    // @param: db - the database
+    // @param: index - the index of the database
+    // @param: query - the query text
+    // @param: bookId - the book to search, empty to search every book
+    // @return: the number of hits of all pages, 0 if the cursors didn't reach the last page
+    auto parsed = parseQuery(query);
+    searchCursor cursor{0, -1, 0, 0};
+    size_t hits = 0;
+    for (int page = 0; page < 100; page++)
+    {
+        auto deadline = makeDeadline(0);
+        auto res = bookId.empty() ? searchAllBooksPage(db, index, parsed.root, cursor, 20, 15, false, &deadline)
+                                  : searchBookPage(db, index, bookId, parsed.root, cursor, 20, 15, false, &deadline);
+        hits += res.results.size();
+        if (!res.hasNext)
+        {
+            return hits;
+        }
+        cursor = res.next;
+    }
+    return 0;
+}
+
+void testPagesWithExpiredDeadline()
+{
+    // Every page has to get past its cursor, even if the deadline expired before the page started
+    sqlite3 *db = openTestDB("./tests/pages.db");
+    searchIndex index;
+    writeIndexed(db, index, [&] { return addBook(db, "1", "Sea", "whale sea whale ship"); });
+    writeIndexed(db, index, [&] { return addBook(db, "2", "Zoo", "zebra lion"); });
+    writeIndexed(db, index, [&] { return addBook(db, "3", "Harbour", "ship whale"); });
+
+    check("phrase pages reach the end", followPages(db, index, "whale", "") == 3);
+    check("NOT pages reach the end", followPages(db, index, "whale AND NOT zebra", "") == 3);
+    check("book pages reach the end", followPages(db, index, "whale OR ship", "1") == 3);
+
+    sqlite3_close(db);
+}
+
+int main()
+{
+    testNegationAfterCostlyOr();
+    testSnapshotOfAnotherDatabase();
+    testPagesWithExpiredDeadline();
+
+    std::cout << (failures == 0 ? "All tests passed" : std::to_string(failures) + " tests failed") << std::endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}